@@ -0,0 +1,89 @@
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+#include "mem.h"
+
+// Macros and Enumerations
+#define MAX_BLOCK (1UL << 20)
+
+// Definitions for each structure
+struct block {
+    struct block *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+struct arena {
+    struct block *head;     // Block currently being carved up
+    size_t next_size;
+    size_t bytes;
+};
+
+// File Specific Prototypes
+struct block *block_create(size_t size);
+
+Arena *arena_create(size_t blocksize) {
+    Arena *a = (Arena *) mem_malloc(sizeof(Arena));
+    if (a == NULL) { return NULL; }
+    a->head = NULL;
+    a->next_size = (blocksize == 0) ? 1 : blocksize;
+    a->bytes = 0;
+    return a;
+}
+
+void *arena_alloc(Arena *a, size_t size, size_t align) {
+    struct block *b = a->head;
+    size_t offset = 0;
+
+    // Bump within the current block if the aligned object still fits
+    if (b != NULL) {
+        offset = (b->used + align - 1) & ~(align - 1);
+    }
+    if (b == NULL || offset + size > b->size) {
+        // Start a fresh block, big enough for this object even if oversized
+        size_t want = a->next_size;
+        while (want < size) { want *= 2; }
+        b = block_create(want);
+        if (b == NULL) { return NULL; }
+        b->next = a->head;
+        a->head = b;
+        if (a->next_size < MAX_BLOCK) { a->next_size *= 2; }
+        offset = 0;
+    }
+    b->used = offset + size;
+    a->bytes += size;
+    return (char *) b->data + offset;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+    char *p = (char *) arena_alloc(a, n + 1, 1);
+    if (p != NULL) {
+        memcpy(p, s, n);
+        p[n] = '\0';
+    }
+    return p;
+}
+
+size_t arena_bytes(Arena *a) {
+    return a->bytes;
+}
+
+void arena_destroy(Arena *a) {
+    struct block *b = a->head;
+    while (b != NULL) {
+        struct block *next = b->next;
+        mem_free(b);
+        b = next;
+    }
+    mem_free(a);
+}
+
+struct block *block_create(size_t size) {
+    struct block *b = (struct block *) mem_malloc(sizeof(struct block) + size);
+    if (b == NULL) { return NULL; }
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
@@ -0,0 +1,41 @@
+#ifndef _ARENA_H_INCLUDED_
+#define _ARENA_H_INCLUDED_
+
+#include <stddef.h>
+
+typedef struct arena Arena;
+
+/*
+ * arena_create creates a bump allocator that carves objects out of large
+ * blocks; nothing is released until the whole arena is destroyed
+ * `blocksize' is the size of the first block, later blocks double up to
+ * a fixed limit
+ * returns pointer to the arena if successful, NULL if not
+ */
+Arena *arena_create(size_t blocksize);
+
+/*
+ * arena_alloc returns `size' bytes aligned to `align' (a power of two);
+ * storage stays put for the life of the arena
+ * returns NULL if a new block could not be allocated
+ */
+void *arena_alloc(Arena *a, size_t size, size_t align);
+
+/*
+ * arena_strndup copies the `n' bytes at `s' into the arena and terminates
+ * them; returns the copy, or NULL if memory could not be allocated
+ */
+char *arena_strndup(Arena *a, const char *s, size_t n);
+
+/*
+ * arena_bytes returns the number of bytes handed out by the arena so far
+ */
+size_t arena_bytes(Arena *a);
+
+/*
+ * arena_destroy returns every block of the arena to the system in one
+ * call per block
+ */
+void arena_destroy(Arena *a);
+
+#endif /* _ARENA_H_INCLUDED_ */
@@ -0,0 +1,229 @@
+#include <string.h>
+#include "ctldlist.h"
+#include "mem.h"
+#include "stats.h"
+#include "logline.h"
+
+// Macros and Enumerations
+#define MIN_BUCKETS 1024        // Must be a power of two
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+// Definitions for each structure
+struct ctldnode {
+    struct ctldnode *chain;     // Next in this bucket, fixed once published
+    struct ctldnode *next;      // Next in the list of every node, newest first
+    unsigned long hash;
+    long count;                 // Only ever touched with atomics
+    size_t len;
+    char tld[];
+};
+
+struct ctldlist {
+    uint32_t first_day;         // begin and end packed, see date_pack
+    uint32_t last_day;
+    struct ctldnode **buckets;  // Chain heads, only ever touched with atomics
+    unsigned long mask;
+    struct ctldnode *all;       // Every node, pushed as it's created
+    long size;
+};
+
+struct ctlditerator {
+    struct ctldnode *pointer;
+};
+
+// File Specific Prototypes
+static CTLDNode *ctldlist_insert(CTLDList *tld, const char *name, size_t len, long count);
+static CTLDNode *ctldnode_create(const char *name, size_t len, unsigned long hash);
+static int ctldnode_match(CTLDNode *node, const char *name, size_t len, unsigned long hash);
+static unsigned long ctldhash(const char *s, size_t len);
+
+CTLDList *ctldlist_create(Date *begin, Date *end, unsigned long expected) {
+    CTLDList *tld;
+    unsigned long buckets = MIN_BUCKETS;
+
+    if (begin == NULL || end == NULL || date_compare(begin, end) > 0) { return NULL; }
+    while (buckets < expected) { buckets *= 2; }
+    tld = (CTLDList *) mem_malloc(sizeof(CTLDList));
+    if (tld == NULL) { return NULL; }
+    tld->buckets = (struct ctldnode **) mem_calloc(buckets, sizeof(struct ctldnode *));
+    if (tld->buckets == NULL) {
+        mem_free(tld);
+        return NULL;
+    }
+    tld->first_day = date_pack(begin);
+    tld->last_day  = date_pack(end);
+    tld->mask      = buckets - 1;
+    tld->all       = NULL;
+    tld->size      = 0;
+    return tld;
+}
+
+void ctldlist_destroy(CTLDList *tld) {
+    CTLDNode *node = tld->all;
+    while (node != NULL) {
+        CTLDNode *next = node->next;
+        mem_free(node);
+        node = next;
+    }
+    mem_free(tld->buckets);
+    mem_free(tld);
+}
+
+int ctldlist_add_packed(CTLDList *tld, const char *tldname, size_t len, uint32_t date) {
+    if (date < tld->first_day || date > tld->last_day) {
+        STATS_ADD(STATS_OUT_OF_RANGE, 1);
+        return 0;
+    }
+    return ctldlist_insert(tld, tldname, len, 1) != NULL;
+}
+
+long ctldlist_add_batch(CTLDList *tld, const TLDHost *hosts, size_t n) {
+    long counted = 0;
+    for (size_t i = 0; i < n; i++) {
+        counted += ctldlist_add_packed(tld, hosts[i].host + hosts[i].hostlen - hosts[i].tldlen,
+                                       hosts[i].tldlen, hosts[i].date);
+    }
+    return counted;
+}
+
+long ctldlist_count(CTLDList *tld) {
+    long total = 0;
+    for (CTLDNode *node = __atomic_load_n(&tld->all, __ATOMIC_ACQUIRE); node != NULL; node = node->next) {
+        total += ctldnode_count(node);
+    }
+    return total;
+}
+
+long ctldlist_size(CTLDList *tld) {
+    return __atomic_load_n(&tld->size, __ATOMIC_RELAXED);
+}
+
+int ctldlist_merge(TLDList *dst, CTLDList *src) {
+    // The list of every node runs newest first, so gather it from one look at
+    // its head, which later pushes cannot change, and add it backwards
+    CTLDNode *head = __atomic_load_n(&src->all, __ATOMIC_ACQUIRE), *node, **nodes;
+    uint32_t first, last;
+    long n = 0;
+    int ok = 1;
+
+    for (node = head; node != NULL; node = node->next) { n++; }
+    nodes = (CTLDNode **) mem_malloc((n > 0 ? n : 1) * sizeof(CTLDNode *));
+    if (nodes == NULL) { return 0; }
+    n = 0;
+    for (node = head; node != NULL; node = node->next) { nodes[n++] = node; }
+    tldlist_window(dst, &first, &last);
+    while (ok && n-- > 0) {
+        // A node whose first add is still under way has nothing to merge yet
+        long count = ctldnode_count(nodes[n]);
+        if (count > 0) { ok = tldlist_add_count(dst, nodes[n]->tld, nodes[n]->len, first, count); }
+    }
+    mem_free(nodes);
+    return ok;
+}
+
+// Counts `count' against `name', creating its node if no thread has yet
+static CTLDNode *ctldlist_insert(CTLDList *tld, const char *name, size_t len, long count) {
+    unsigned long hash = ctldhash(name, len);
+    CTLDNode **bucket = &tld->buckets[hash & tld->mask];
+    CTLDNode *head = __atomic_load_n(bucket, __ATOMIC_ACQUIRE), *stop = NULL, *fresh = NULL, *node;
+
+    for (;;) {
+        // Only the nodes pushed since the last look can be new
+        for (node = head; node != stop; node = node->chain) {
+            if (ctldnode_match(node, name, len, hash)) {
+                if (fresh != NULL) { mem_free(fresh); }
+                __atomic_fetch_add(&node->count, count, __ATOMIC_RELAXED);
+                return node;
+            }
+        }
+        if (fresh == NULL) {
+            fresh = ctldnode_create(name, len, hash);
+            if (fresh == NULL) { return NULL; }
+        }
+        fresh->chain = head;
+        if (__atomic_compare_exchange_n(bucket, &head, fresh, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        stop = fresh->chain;
+    }
+
+    // Published: now onto the list of every node, for iterators
+    fresh->next = __atomic_load_n(&tld->all, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&tld->all, &fresh->next, fresh, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        ;
+    }
+    __atomic_fetch_add(&tld->size, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fresh->count, count, __ATOMIC_RELAXED);
+    STATS_ADD(STATS_NEW_KEYS, 1);
+    return fresh;
+}
+
+/*
+/
+/ CTLDIterator Implementation
+/
+*/
+
+CTLDIterator *ctldlist_iter_create(CTLDList *tld) {
+    CTLDIterator *iter = (CTLDIterator *) mem_malloc(sizeof(CTLDIterator));
+    if (iter == NULL) { return NULL; }
+    iter->pointer = __atomic_load_n(&tld->all, __ATOMIC_ACQUIRE);
+    return iter;
+}
+
+CTLDNode *ctldlist_iter_next(CTLDIterator *iter) {
+    CTLDNode *node = iter->pointer;
+    if (node != NULL) { iter->pointer = node->next; }
+    return node;
+}
+
+void ctldlist_iter_destroy(CTLDIterator *iter) {
+    mem_free(iter);
+}
+
+/*
+/
+/ CTLDNode Implementation
+/
+*/
+
+const char *ctldnode_tldname(CTLDNode *node) {
+    return node->tld;
+}
+
+long ctldnode_count(CTLDNode *node) {
+    return __atomic_load_n(&node->count, __ATOMIC_RELAXED);
+}
+
+// The node and its name come from one allocation, made only for a new TLD
+static CTLDNode *ctldnode_create(const char *name, size_t len, unsigned long hash) {
+    CTLDNode *node = (CTLDNode *) mem_malloc(sizeof(CTLDNode) + len + 1);
+    if (node == NULL) { return NULL; }
+    node->chain = NULL;
+    node->next  = NULL;
+    node->hash  = hash;
+    node->count = 0;
+    node->len   = len;
+    memcpy(node->tld, name, len);
+    node->tld[len] = '\0';
+    return node;
+}
+
+static int ctldnode_match(CTLDNode *node, const char *name, size_t len, unsigned long hash) {
+    if (node->hash != hash || node->len != len) { return 0; }
+    for (size_t i = 0; i < len; i++) {
+        if (LOGLINE_FOLD(name[i]) != LOGLINE_FOLD(node->tld[i])) { return 0; }
+    }
+    return 1;
+}
+
+// FNV-1a over the lower-cased key, as the TLDList hash table uses
+static unsigned long ctldhash(const char *s, size_t len) {
+    unsigned long hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= LOGLINE_FOLD(s[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
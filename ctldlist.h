@@ -0,0 +1,106 @@
+#ifndef _CTLDLIST_H_INCLUDED_
+#define _CTLDLIST_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "date.h"
+#include "tldlist.h"
+
+typedef struct ctldlist CTLDList;
+typedef struct ctldnode CTLDNode;
+typedef struct ctlditerator CTLDIterator;
+
+/*
+ * a CTLDList is a TLDList that any number of threads can add to at once,
+ * without a lock: a TLD already in the list is counted with one relaxed
+ * atomic add to its node, and a new TLD is pushed onto its bucket's chain
+ * with a compare-and-swap, so threads only contend when they add the same
+ * new TLD at the same moment
+ *
+ * nodes are never moved or freed until the list is destroyed, so the list
+ * can be iterated and counted while threads are still adding to it; each
+ * count read is one that was current at some point during the walk
+ *
+ * it keeps only counts: no day buckets, sketches or trie
+ */
+
+/*
+ * ctldlist_create creates an empty concurrent list constrained to the
+ * `begin' and `end' Date's, with a bucket for about every `expected' TLDs;
+ * the buckets are fixed for the life of the list, so more TLDs than that
+ * only make their chains longer
+ * returns a pointer to the list if successful, NULL if not
+ */
+CTLDList *ctldlist_create(Date *begin, Date *end, unsigned long expected);
+
+/*
+ * ctldlist_destroy frees the list and every node in it; no thread may be
+ * using the list
+ */
+void ctldlist_destroy(CTLDList *tld);
+
+/*
+ * ctldlist_add_packed is tldlist_add_packed() for a concurrent list, and
+ * safe to call from any number of threads at once
+ * returns 1 if the entry was counted, 0 if not
+ */
+int ctldlist_add_packed(CTLDList *tld, const char *tldname, size_t len, uint32_t date);
+
+/*
+ * ctldlist_add_batch is tldlist_add_batch() for a concurrent list; the
+ * TLDs of each entry's hostname are counted, the hostnames themselves are
+ * not kept
+ * returns the number of entries counted
+ */
+long ctldlist_add_batch(CTLDList *tld, const TLDHost *hosts, size_t n);
+
+/*
+ * ctldlist_count returns the number of entries counted, by summing the
+ * nodes, so it is O(size) and only a lower bound while threads are adding
+ */
+long ctldlist_count(CTLDList *tld);
+
+/*
+ * ctldlist_size returns the number of distinct TLDs held in the list
+ */
+long ctldlist_size(CTLDList *tld);
+
+/*
+ * ctldlist_merge adds the counts held in `src' to the ordinary list
+ * `dst', in the order the TLDs were first added to `src'; the counts go
+ * against the first day of `dst''s window, which must cover the window of
+ * `src'
+ * returns 1 if successful, 0 if not (memory allocation failure)
+ */
+int ctldlist_merge(TLDList *dst, CTLDList *src);
+
+/*
+ * ctldlist_iter_create creates an iterator over the list, which returns
+ * the TLDs most recently added first; TLDs added after the iterator was
+ * created are not returned
+ * returns a pointer to the iterator if successful, NULL if not
+ */
+CTLDIterator *ctldlist_iter_create(CTLDList *tld);
+
+/*
+ * ctldlist_iter_next returns the next node of the list, NULL if there are
+ * no more
+ */
+CTLDNode *ctldlist_iter_next(CTLDIterator *iter);
+
+/*
+ * ctldlist_iter_destroy destroys the iterator specified by `iter'
+ */
+void ctldlist_iter_destroy(CTLDIterator *iter);
+
+/*
+ * ctldnode_tldname returns the TLD of the node
+ */
+const char *ctldnode_tldname(CTLDNode *node);
+
+/*
+ * ctldnode_count returns the node's count at the moment it is read
+ */
+long ctldnode_count(CTLDNode *node);
+
+#endif /* _CTLDLIST_H_INCLUDED_ */
@@ -5,12 +5,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "date.h"
+#include "mem.h"
 
 // Macros and Enumerations
 #define NUMB_BASE 10
 enum FORMATING {DAYS = 2, MONTHS = 2, YEARS = 4};
 
+// Byte masks over the first 8 bytes "dd/mm/yy" of a date, loaded little-endian
+#define SWAR_DIGITS 0xFFFF00FFFF00FFFFULL    // Digit positions
+#define SWAR_SLASH_MASK 0x0000FF0000FF0000ULL
+#define SWAR_SLASHES 0x00002F00002F0000ULL   // '/' at bytes 2 and 5
+#define SWAR_ZEROES (0x3030303030303030ULL & SWAR_DIGITS)
+#define SWAR_HIGH (0xF0F0F0F0F0F0F0F0ULL & SWAR_DIGITS)
+#define SWAR_SIXES (0x0606060606060606ULL & SWAR_DIGITS)
+
+// Days in each month, February counted in a leap year
+static const unsigned char month_days[13] = {0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
 // Definitions for each structure
 struct date {
     int day;
@@ -19,47 +32,122 @@ struct date {
 };
 
 // File Specific Prototypes
-int getNumber(char *str, int *pos, enum FORMATING format);
+int getNumber(const char *str, int *pos, enum FORMATING format);
 
 Date *date_create(char *datestr) {
-    Date *date = (Date *)malloc(sizeof(Date));
-    int pos = 0;
-    date->day = getNumber(datestr, &pos, DAYS);
-    date->month = getNumber(datestr, &pos, MONTHS);
-    date->year = getNumber(datestr, &pos, YEARS);
-    
-    // Make sure date is in correct format
-    if (date->day == -1 || date->month == -1 || date->year == -1) {
+    Date *date = (Date *)mem_malloc(sizeof(Date));
+    if (date == NULL) {
+        return NULL;
+    }
+    if (date_parse(date, datestr) == NULL) {
         date_destroy(date);
         return NULL;
-    } 
+    }
     return date;
 }
 
+Date *date_parse(Date *d, const char *datestr) {
+    int pos = 0;
+    int day = getNumber(datestr, &pos, DAYS);
+    int month = getNumber(datestr, &pos, MONTHS);
+    int year = getNumber(datestr, &pos, YEARS);
+
+    // Make sure date is in correct format before touching `d'
+    if (day == -1 || month == -1 || year == -1) {
+        return NULL;
+    }
+    d->day = day;
+    d->month = month;
+    d->year = year;
+    return d;
+}
+
 int date_compare(Date *date1, Date *date2) {
-    int comparison = 0;
-    if (date1->year == date2->year){
-        if (date1->month<date2->month) {
-            comparison = -1;
-        } else if (date1->month>date2->month) {
-            comparison = 1;
-        } else if (date1->day<date2->day) {
-            comparison = -1;
-        } else if(date1->day>date2->day) {
-            comparison = 1;
-        } else {
-            comparison = 0;
-        }
-    } else if (date1->year < date2->year) {
-       comparison = -1;
-    } else {
-       comparison = 1;
+    // Packed dates order the same way as the dates themselves
+    uint32_t packed1 = date_pack(date1);
+    uint32_t packed2 = date_pack(date2);
+    return (packed1 > packed2) - (packed1 < packed2);
+}
+
+uint32_t date_pack(Date *d) {
+    return (uint32_t) (d->year * 10000 + d->month * 100 + d->day);
+}
+
+long date_days(uint32_t packed) {
+    // Days from civil date, counting years from March so the leap day comes last
+    long year = packed / 10000, month = packed / 100 % 100, day = packed % 100;
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yoe = year - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+uint32_t date_from_days(long days) {
+    // The inverse of date_days, again in years that start in March
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long doe = days - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    long day = doy - (153 * mp + 2) / 5 + 1;
+    long month = mp < 10 ? mp + 3 : mp - 9;
+    long year = yoe + era * 400 + (month <= 2);
+    return (uint32_t) (year * 10000 + month * 100 + day);
+}
+
+Date *date_unpack(uint32_t packed) {
+    Date *date = (Date *) mem_malloc(sizeof(Date));
+    if (date == NULL) {
+        return NULL;
+    }
+    date->day = packed % 100;
+    date->month = packed / 100 % 100;
+    date->year = packed / 10000;
+    return date;
+}
+
+int date_parse_packed(const char *datestr, uint32_t *packed) {
+    uint64_t word;
+    unsigned char tail[3];
+    memcpy(&word, datestr, sizeof(word));
+    memcpy(tail, datestr + sizeof(word), sizeof(tail));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    // Every digit byte must be 0x30..0x39: high nibble 3, and adding 6 must not carry out of the low nibble
+    if ((word & SWAR_HIGH) != SWAR_ZEROES || ((word + SWAR_SIXES) & SWAR_HIGH) != SWAR_ZEROES) {
+        return 0;
+    }
+    if ((word & SWAR_SLASH_MASK) != SWAR_SLASHES) {
+        return 0;
+    }
+    if (tail[0] < '0' || tail[0] > '9' || tail[1] < '0' || tail[1] > '9' || (tail[2] >= '0' && tail[2] <= '9')) {
+        return 0;
+    }
+
+    // Turn the digits into 0..9, then fold each tens byte into its units byte's neighbour in one multiply-add
+    word = (word - SWAR_ZEROES) & SWAR_DIGITS;
+    word = word * NUMB_BASE + (word >> 8);
+    uint32_t day = word & 0xFF;
+    uint32_t month = (word >> 24) & 0xFF;
+    uint32_t year = ((word >> 48) & 0xFF) * 100 + (tail[0] - '0') * NUMB_BASE + (tail[1] - '0');
+    if (month < 1 || month > 12 || day < 1 || day > month_days[month]) {
+        return 0;
+    }
+    // 29/02 only exists in leap years
+    if (month == 2 && day == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0))) {
+        return 0;
     }
-    return comparison;
+    *packed = year * 10000 + month * 100 + day;
+    return 1;
 }
 
 Date *date_duplicate(Date *d) {
-    Date *date = (Date *) malloc(sizeof(Date));
+    Date *date = (Date *) mem_malloc(sizeof(Date));
     if (date != NULL) {
         *date = *d;
     } else {
@@ -69,12 +157,12 @@ Date *date_duplicate(Date *d) {
 }
 
 void date_destroy(Date *d) {
-    free(d);
+    mem_free(d);
 }
 
 // Given a format such as in the FORMARTING enum, return whether or not a substring of a date string is in the correct format
 // If wrong format, return -1 
-int getNumber(char *str, int *pos, enum FORMATING format) {
+int getNumber(const char *str, int *pos, enum FORMATING format) {
     int number = 0;
     int format_count = format;
     str = str + (*pos);
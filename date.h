@@ -1,6 +1,8 @@
 #ifndef _DATE_H_INCLUDED_
 #define _DATE_H_INCLUDED_
 
+#include <stdint.h>
+
 typedef struct date Date;
 
 /*
@@ -11,6 +13,14 @@ typedef struct date Date;
  */
 Date *date_create(char *datestr);
 
+/*
+ * date_parse re-reads `datestr' ("dd/mm/yyyy") into the existing Date `d',
+ * so one Date can be reused for every line of a log without allocating;
+ * `datestr' need not be NUL-terminated after the year
+ * returns `d' if successful, NULL if not (syntax error, `d' is unchanged)
+ */
+Date *date_parse(Date *d, const char *datestr);
+
 /*
  * date_duplicate creates a duplicate of `d'
  * returns pointer to new Date structure if successful,
@@ -24,6 +34,40 @@ Date *date_duplicate(Date *d);
  */
 int date_compare(Date *date1, Date *date2);
 
+/*
+ * date_pack returns `d' as the integer yyyymmdd; packed dates compare
+ * with ordinary integer comparisons
+ */
+uint32_t date_pack(Date *d);
+
+/*
+ * date_days returns the packed date `packed' as a day number, counting from
+ * 01/01/1970, so that the days between two dates is a subtraction
+ */
+long date_days(uint32_t packed);
+
+/*
+ * date_from_days is the inverse of date_days, returning the packed date of
+ * day number `days'
+ */
+uint32_t date_from_days(long days);
+
+/*
+ * date_unpack creates a Date structure from the packed date `packed'
+ * returns pointer to Date structure if successful,
+ *         NULL if not (memory allocation failure)
+ */
+Date *date_unpack(uint32_t packed);
+
+/*
+ * date_parse_packed reads the "dd/mm/yyyy" field at `datestr' straight into
+ * its packed yyyymmdd form, without allocating a Date; exactly 11 bytes are
+ * read, and the byte after the year must not be a digit
+ * returns 1 if successful, 0 if not (syntax error, or a month out of
+ * range or a day that month does not have)
+ */
+int date_parse_packed(const char *datestr, uint32_t *packed);
+
 /*
  * date_destroy returns any storage associated with `d' to the system
  */
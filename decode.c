@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "decode.h"
+#include "ingest.h"
+#include "logline.h"
+#include "mem.h"
+#include "stats.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Macros and Enumerations
+#define MAGIC_GZIP "\x1f\x8b"
+#define MAGIC_ZSTD "\x28\xb5\x2f\xfd"
+#define DECODE_SLOTS 4          // Blocks in flight between the threads
+#define DECODE_BLOCK (1 << 20)  // Decoded bytes per block
+#define DECODE_IN (1 << 16)     // Compressed bytes read at a time
+
+// Definitions for each structure
+struct slot {
+    char *data;                 // LOGLINE_MAX bytes into the allocation, see decode_stream
+    size_t len;
+};
+
+struct decoder {
+    int fd;
+    const char *taken;          // Bytes the caller read from `fd' already
+    size_t ntaken;
+    enum decode_format format;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;      // Signalled when a block is ready, or the stream ends
+    pthread_cond_t emptied;     // Signalled when a block is free, or on stop
+    struct slot slots[DECODE_SLOTS];
+    int head, tail, count;      // Next block to count, next to fill, blocks ready
+    int done;                   // No more blocks will come
+    int parked;                 // The counting side is waiting for a block
+    int eof;                    // The input ran out
+    int stop;                   // The counting side gave up, stop decoding
+    int error;                  // Corrupt or truncated input
+    int ended;                  // The last compressed frame was complete
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *zd;
+    ZSTD_inBuffer zin;
+#endif
+    unsigned char in[DECODE_IN];
+};
+
+// File Specific Prototypes
+static void *decode_thread(void *arg);
+static size_t decode_fill(struct decoder *d, char *out, size_t cap);
+static ssize_t decode_read(struct decoder *d);
+static int magic(const void *head, size_t len, const char *number, size_t n);
+static int codec_init(struct decoder *d);
+static void codec_end(struct decoder *d);
+
+enum decode_format decode_detect(const void *head, size_t len) {
+    if (magic(head, len, MAGIC_GZIP, sizeof(MAGIC_GZIP) - 1)) { return DECODE_GZIP; }
+    if (magic(head, len, MAGIC_ZSTD, sizeof(MAGIC_ZSTD) - 1)) { return DECODE_ZSTD; }
+    return DECODE_NONE;
+}
+
+static int magic(const void *head, size_t len, const char *number, size_t n) {
+    return len > 0 && memcmp(head, number, (len < n) ? len : n) == 0;
+}
+
+const char *decode_name(enum decode_format format) {
+    switch (format) {
+    case DECODE_GZIP: return "gzip";
+    case DECODE_ZSTD: return "zstd";
+    default: return "plain";
+    }
+}
+
+int decode_supported(enum decode_format format) {
+    switch (format) {
+#ifdef HAVE_ZLIB
+    case DECODE_GZIP: return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case DECODE_ZSTD: return 1;
+#endif
+    default: return 0;
+    }
+}
+
+int decode_stream(int fd, const char *head, size_t len, enum decode_format format, TLDList *tld, unsigned long *lines) {
+    struct decoder *d = (struct decoder *) mem_calloc(1, sizeof(struct decoder));
+    pthread_t tid;
+    char carry[LOGLINE_MAX];
+    size_t have = 0;
+    const char *bad = NULL;
+    int i, status;
+
+    if (d == NULL) { return -1; }
+    d->fd = fd;
+    d->taken = head;
+    d->ntaken = len;
+    d->format = format;
+    for (i = 0; i < DECODE_SLOTS; i++) {
+        char *block = (char *) mem_malloc(LOGLINE_MAX + DECODE_BLOCK);
+        d->slots[i].data = (block == NULL) ? NULL : block + LOGLINE_MAX;
+        if (block == NULL) { goto fail; }
+    }
+    if (!codec_init(d)) { goto fail; }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->filled, NULL);
+    pthread_cond_init(&d->emptied, NULL);
+    if (pthread_create(&tid, NULL, decode_thread, d) != 0) {
+        codec_end(d);
+        goto fail;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&d->lock);
+        __atomic_store_n(&d->parked, 1, __ATOMIC_RELAXED);
+        while (d->count == 0 && !d->done) { pthread_cond_wait(&d->filled, &d->lock); }
+        __atomic_store_n(&d->parked, 0, __ATOMIC_RELAXED);
+        if (d->count == 0) {
+            pthread_mutex_unlock(&d->lock);
+            break;
+        }
+        struct slot *s = &d->slots[d->head];
+        pthread_mutex_unlock(&d->lock);
+
+        // The incomplete line from the last block goes in the room kept in front of this one
+        char *start = s->data - have;
+        size_t len = have + s->len;
+        memcpy(start, carry, have);
+        size_t used = ingest_lines(tld, start, len, 0, &bad, lines);
+        if (bad == NULL) {
+            have = len - used;
+            memcpy(carry, start + used, have);
+        }
+
+        pthread_mutex_lock(&d->lock);
+        d->head = (d->head + 1) % DECODE_SLOTS;
+        d->count--;
+        d->stop = (bad != NULL);
+        pthread_cond_signal(&d->emptied);
+        pthread_mutex_unlock(&d->lock);
+        if (bad != NULL) {
+            ingest_illegal(bad, start + len);
+            break;
+        }
+    }
+    // The decoder could be blocked on a pipe that never ends, so once the
+    // count has stopped it is cancelled rather than waited for
+    if (bad != NULL) {
+        pthread_cancel(tid);
+    }
+    pthread_join(tid, NULL);
+
+    // Whatever is left had no newline, which only the end of the input can excuse
+    if (bad == NULL && have > 0 && !d->error) {
+        (void) ingest_lines(tld, carry, have, 1, &bad, lines);
+        if (bad != NULL) { ingest_illegal(bad, carry + have); }
+    }
+    status = d->error ? -1 : 0;
+    codec_end(d);
+    pthread_cond_destroy(&d->emptied);
+    pthread_cond_destroy(&d->filled);
+    pthread_mutex_destroy(&d->lock);
+    for (i = 0; i < DECODE_SLOTS; i++) { mem_free(d->slots[i].data - LOGLINE_MAX); }
+    mem_free(d);
+    return status;
+
+fail:
+    for (i = 0; i < DECODE_SLOTS; i++) {
+        if (d->slots[i].data != NULL) { mem_free(d->slots[i].data - LOGLINE_MAX); }
+    }
+    mem_free(d);
+    return -1;
+}
+
+// Fill free blocks until the input ends, or the counting side stops us;
+// only a read may be cancelled, never a wait that holds the lock
+static void *decode_thread(void *arg) {
+    struct decoder *d = arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    for (;;) {
+        pthread_mutex_lock(&d->lock);
+        while (d->count == DECODE_SLOTS && !d->stop) { pthread_cond_wait(&d->emptied, &d->lock); }
+        if (d->stop) {
+            d->done = 1;
+            pthread_mutex_unlock(&d->lock);
+            break;
+        }
+        struct slot *s = &d->slots[d->tail];
+        pthread_mutex_unlock(&d->lock);
+
+        STATS_START(reading);
+        s->len = decode_fill(d, s->data, DECODE_BLOCK);
+        STATS_STOP(STATS_READ, reading);
+
+        pthread_mutex_lock(&d->lock);
+        if (s->len > 0) {
+            d->tail = (d->tail + 1) % DECODE_SLOTS;
+            d->count++;
+        }
+        // A short block may just be all a pipe had so far
+        d->done = d->eof || d->error;
+        pthread_cond_signal(&d->filled);
+        pthread_mutex_unlock(&d->lock);
+        if (d->done) { break; }
+    }
+    stats_flush();
+    return NULL;
+}
+
+/*
+/
+/ Codecs
+/
+*/
+
+static int codec_init(struct decoder *d) {
+    switch (d->format) {
+#ifdef HAVE_ZLIB
+    case DECODE_GZIP:
+        // 32 asks zlib to take either a gzip or a zlib header
+        return inflateInit2(&d->zs, 15 + 32) == Z_OK;
+#endif
+#ifdef HAVE_ZSTD
+    case DECODE_ZSTD:
+        d->zd = ZSTD_createDCtx();
+        d->zin.src = d->in;
+        return d->zd != NULL;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void codec_end(struct decoder *d) {
+    switch (d->format) {
+#ifdef HAVE_ZLIB
+    case DECODE_GZIP: inflateEnd(&d->zs); break;
+#endif
+#ifdef HAVE_ZSTD
+    case DECODE_ZSTD: ZSTD_freeDCtx(d->zd); break;
+#endif
+    default: break;
+    }
+}
+
+// Decode up to `cap' bytes into `out', fewer at the end of the input, on an
+// error, or when the input has to be waited for and the counting side is idle
+static size_t decode_fill(struct decoder *d, char *out, size_t cap) {
+    switch (d->format) {
+#ifdef HAVE_ZLIB
+    case DECODE_GZIP: {
+        z_stream *zs = &d->zs;
+        zs->next_out = (unsigned char *) out;
+        zs->avail_out = cap;
+        while (zs->avail_out > 0) {
+            if (zs->avail_in == 0) {
+                // A pipe may keep the next read waiting, so hand over what there is if it's wanted
+                if (zs->avail_out < cap && __atomic_load_n(&d->parked, __ATOMIC_RELAXED)) { break; }
+                ssize_t got = decode_read(d);
+                zs->avail_in = (got > 0) ? got : 0;
+                zs->next_in = d->in;
+                if (got <= 0) {
+                    d->eof = 1;
+                    d->error = !d->ended || got < 0;
+                    break;
+                }
+            }
+            int ret = inflate(zs, Z_NO_FLUSH);
+            d->ended = (ret == Z_STREAM_END);
+            if (ret == Z_STREAM_END) {
+                // Concatenated members, as `cat a.gz b.gz' makes, are one stream to gzip
+                inflateReset(zs);
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                d->error = 1;
+                break;
+            }
+        }
+        return cap - zs->avail_out;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case DECODE_ZSTD: {
+        ZSTD_outBuffer zout = { out, cap, 0 };
+        while (zout.pos < zout.size) {
+            if (d->zin.pos == d->zin.size) {
+                if (zout.pos > 0 && __atomic_load_n(&d->parked, __ATOMIC_RELAXED)) { break; }
+                ssize_t got = decode_read(d);
+                d->zin.size = (got > 0) ? got : 0;
+                d->zin.pos = 0;
+                if (got <= 0) {
+                    d->eof = 1;
+                    d->error = !d->ended || got < 0;
+                    break;
+                }
+            }
+            size_t ret = ZSTD_decompressStream(d->zd, &zout, &d->zin);
+            if (ZSTD_isError(ret)) {
+                d->error = 1;
+                break;
+            }
+            d->ended = (ret == 0);
+        }
+        return zout.pos;
+    }
+#endif
+    default:
+        // Only reached with neither codec built in, when `out' and `cap' go unused
+        (void) out;
+        (void) cap;
+        d->error = 1;
+        return 0;
+    }
+}
+
+// Read the next compressed bytes into d->in, the ones the caller already
+// took first; returns 0 at the end of the input, -1 on an error
+static ssize_t decode_read(struct decoder *d) {
+    ssize_t got;
+    int old;
+
+    if (d->ntaken > 0) {
+        got = (d->ntaken < DECODE_IN) ? d->ntaken : DECODE_IN;
+        memcpy(d->in, d->taken, got);
+        d->taken += got;
+        d->ntaken -= got;
+        return got;
+    }
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old);
+    do {
+        got = read(d->fd, d->in, DECODE_IN);
+    } while (got < 0 && errno == EINTR);
+    pthread_setcancelstate(old, NULL);
+    return got;
+}
@@ -0,0 +1,46 @@
+#ifndef _DECODE_H_INCLUDED_
+#define _DECODE_H_INCLUDED_
+
+#include <stddef.h>
+#include "tldlist.h"
+
+/*
+ * the compressed formats an input can be in; gzip needs a build with zlib
+ * (HAVE_ZLIB) and zstd one with libzstd (HAVE_ZSTD)
+ */
+enum decode_format { DECODE_NONE, DECODE_GZIP, DECODE_ZSTD };
+
+/*
+ * decode_detect identifies the format of a file from its first `len'
+ * bytes at `head', checking as much of each magic number as `len' covers;
+ * neither magic can begin a legal log line, so a one-byte peek at a stream
+ * is enough to choose
+ * returns DECODE_NONE for anything not compressed
+ */
+enum decode_format decode_detect(const void *head, size_t len);
+
+/*
+ * decode_name returns the name of `format' for messages
+ */
+const char *decode_name(enum decode_format format);
+
+/*
+ * decode_supported returns 1 if this build can decode `format', 0 if not
+ */
+int decode_supported(enum decode_format format);
+
+/*
+ * decode_stream decompresses the descriptor `fd', which holds `format' data
+ * and whose first `len' bytes were read into `head' already, on a thread of
+ * its own, and counts the log lines into `tld' as the decoded blocks come
+ * through a bounded ring, so that decoding overlaps counting; lines are
+ * treated as in a mapped file, stopping at the first illegal one, when the
+ * decoding thread is cancelled rather than left to read the rest
+ * `*lines' is increased by the number of lines counted
+ * returns 0 if successful, -1 if the data is corrupt or truncated (the
+ * lines decoded before the damage are still counted) or the decoder could
+ * not be set up
+ */
+int decode_stream(int fd, const char *head, size_t len, enum decode_format format, TLDList *tld, unsigned long *lines);
+
+#endif /* _DECODE_H_INCLUDED_ */
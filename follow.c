@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "follow.h"
+#include "ingest.h"
+#include "mem.h"
+#include "stats.h"
+
+// Macros and Enumerations
+#define FOLLOW_BUF (1 << 16)    // Read buffer per file, well over LOGLINE_MAX
+
+// Definitions for each structure
+struct followed {
+    const char *path;
+    int fd;                     // -1 until the file can be opened
+    dev_t dev;
+    ino_t ino;
+    int regular;                // Pipes and terminals are polled before reading
+    off_t offset;               // Bytes read from the current file
+    size_t have;                // Bytes of an incomplete line held in buf
+    int skipping;               // Discarding the rest of an over-long line
+    char buf[FOLLOW_BUF];
+};
+
+struct follower {
+    TLDList *tld;
+    struct followed **files;
+    int nfiles;
+    unsigned long lines;
+};
+
+// File Specific Prototypes
+static int reopen(struct followed *ff);
+static void drain(Follower *f, struct followed *ff);
+static void consume(Follower *f, struct followed *ff, int final);
+
+Follower *follow_create(TLDList *tld) {
+    Follower *f = (Follower *) mem_malloc(sizeof(Follower));
+    if (f == NULL) { return NULL; }
+    f->tld = tld;
+    f->files = NULL;
+    f->nfiles = 0;
+    f->lines = 0;
+    return f;
+}
+
+int follow_add(Follower *f, const char *path) {
+    struct followed *ff = (struct followed *) mem_malloc(sizeof(struct followed));
+    struct followed **files = (struct followed **) mem_malloc((f->nfiles + 1) * sizeof(struct followed *));
+    if (ff == NULL || files == NULL) {
+        mem_free(ff);
+        mem_free(files);
+        return -1;
+    }
+    if (f->nfiles > 0) {
+        memcpy(files, f->files, f->nfiles * sizeof(struct followed *));
+        mem_free(f->files);
+    }
+    f->files = files;
+    f->files[f->nfiles++] = ff;
+
+    ff->path = path;
+    ff->fd = -1;
+    ff->offset = 0;
+    ff->have = 0;
+    ff->skipping = 0;
+    (void) reopen(ff);
+    return 0;
+}
+
+unsigned long follow_poll(Follower *f) {
+    unsigned long before = f->lines;
+    struct stat st;
+
+    for (int i = 0; i < f->nfiles; i++) {
+        struct followed *ff = f->files[i];
+        if (ff->fd < 0 && reopen(ff) < 0) { continue; }
+        drain(f, ff);
+        if (ff->fd == STDIN_FILENO || stat(ff->path, &st) < 0) { continue; }
+
+        if (st.st_dev != ff->dev || st.st_ino != ff->ino) {
+            // Rotated: pick up anything written just before the switch, then move to the new file
+            drain(f, ff);
+            consume(f, ff, 1);
+            close(ff->fd);
+            ff->fd = -1;
+            (void) reopen(ff);
+        } else if (st.st_size < ff->offset) {
+            // Truncated in place, start again from the top
+            (void) lseek(ff->fd, 0, SEEK_SET);
+            ff->offset = 0;
+            ff->have = 0;
+            ff->skipping = 0;
+        }
+    }
+    return f->lines - before;
+}
+
+void follow_set_list(Follower *f, TLDList *tld) {
+    f->tld = tld;
+}
+
+unsigned long follow_lines(Follower *f) {
+    return f->lines;
+}
+
+void follow_destroy(Follower *f) {
+    for (int i = 0; i < f->nfiles; i++) {
+        if (f->files[i]->fd > STDIN_FILENO) { close(f->files[i]->fd); }
+        mem_free(f->files[i]);
+    }
+    mem_free(f->files);
+    mem_free(f);
+}
+
+static int reopen(struct followed *ff) {
+    struct stat st;
+    int fd = (strcmp(ff->path, "-") == 0) ? STDIN_FILENO : open(ff->path, O_RDONLY);
+    if (fd < 0) { return -1; }
+    if (fstat(fd, &st) < 0) {
+        if (fd != STDIN_FILENO) { close(fd); }
+        return -1;
+    }
+    ff->fd = fd;
+    ff->dev = st.st_dev;
+    ff->ino = st.st_ino;
+    ff->regular = S_ISREG(st.st_mode);
+    ff->offset = 0;
+    ff->have = 0;
+    ff->skipping = 0;
+    return 0;
+}
+
+// Read until the end of what has been written so far, counting as we go
+static void drain(Follower *f, struct followed *ff) {
+    struct pollfd pfd = { .fd = ff->fd, .events = POLLIN };
+    for (;;) {
+        if (!ff->regular && poll(&pfd, 1, 0) <= 0) { return; }
+        STATS_START(reading);
+        ssize_t got = read(ff->fd, ff->buf + ff->have, FOLLOW_BUF - ff->have);
+        STATS_STOP(STATS_READ, reading);
+        if (got < 0 && errno == EINTR) { continue; }
+        if (got <= 0) { return; }
+        ff->offset += got;
+        ff->have += got;
+        consume(f, ff, 0);
+    }
+}
+
+// Count the complete lines in the buffer and keep any incomplete tail for later
+static void consume(Follower *f, struct followed *ff, int final) {
+    char *p = ff->buf, *end = ff->buf + ff->have, *nl;
+    const char *bad;
+
+    if (ff->skipping) {
+        nl = memchr(p, '\n', end - p);
+        if (nl == NULL) { ff->have = 0; return; }
+        p = nl + 1;
+        ff->skipping = 0;
+    }
+    while (p < end) {
+        p += ingest_lines(f->tld, p, end - p, final, &bad, &f->lines);
+        if (bad == NULL) { break; }
+        ingest_illegal(bad, end);
+        nl = memchr(bad, '\n', end - bad);
+        if (nl == NULL) {
+            ff->skipping = !final;
+            p = end;
+            break;
+        }
+        p = nl + 1;
+    }
+    memmove(ff->buf, p, end - p);
+    ff->have = end - p;
+}
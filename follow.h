@@ -0,0 +1,50 @@
+#ifndef _FOLLOW_H_INCLUDED_
+#define _FOLLOW_H_INCLUDED_
+
+#include "tldlist.h"
+
+typedef struct follower Follower;
+
+/*
+ * follow_create creates a follower that feeds lines appended to a set of
+ * log files into `tld', in the manner of `tail -F'
+ * returns pointer to the follower if successful, NULL if not
+ */
+Follower *follow_create(TLDList *tld);
+
+/*
+ * follow_add starts following `path' ("-" for stdin) from its beginning;
+ * a file that does not exist yet is picked up once it appears; `path' is
+ * borrowed and must outlive the follower
+ * returns 0 if successful, -1 if not (memory allocation failure)
+ */
+int follow_add(Follower *f, const char *path);
+
+/*
+ * follow_poll reads whatever has been appended to each followed file since
+ * the last call and counts its complete lines, without blocking; a file
+ * that has been replaced (rotated) is drained and then reopened by name,
+ * and one that has been truncated is read again from the start; illegal
+ * lines are reported and skipped
+ * returns the number of lines read by this call
+ */
+unsigned long follow_poll(Follower *f);
+
+/*
+ * follow_set_list makes the follower count into `tld' from now on; the
+ * incomplete last line of a file, if any, goes to `tld' once it is complete
+ */
+void follow_set_list(Follower *f, TLDList *tld);
+
+/*
+ * follow_lines returns the number of lines read since the follower was
+ * created
+ */
+unsigned long follow_lines(Follower *f);
+
+/*
+ * follow_destroy closes every followed file and frees the follower
+ */
+void follow_destroy(Follower *f);
+
+#endif /* _FOLLOW_H_INCLUDED_ */
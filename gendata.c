@@ -0,0 +1,178 @@
+#include "date.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * gendata writes a synthetic log of "dd/mm/yyyy hostname" lines to stdout
+ * for benchmarking, and optionally the report tldmonitor --sort=count
+ * should print for it over the whole generated window
+ */
+
+#define USAGE "usage: %s [-n lines] [-k tlds] [-s skew] [-b begin] [-e end] [-o ordered] [-S seed] [-r reference]\n"
+#define OUTBUF (1 << 20)
+
+/* the commonest real TLDs come first, the rest are made up as "x" + letters */
+static const char *real[] = {
+    "com", "org", "net", "de", "uk", "cn", "ru", "nl", "br", "au",
+    "fr", "it", "pl", "jp", "in", "ca", "es", "io", "info", "edu",
+    "gov", "ch", "se", "kr", "be", "at", "dk", "no", "mx", "za"
+};
+
+struct tld {
+    char name[16];
+    size_t len;
+    long count;
+};
+
+static unsigned long long state = 0x9E3779B97F4A7C15ULL;
+
+/* xorshift64*, plenty for test data and identical on every platform */
+static unsigned long long next(void) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static double uniform(void) {
+    return (next() >> 11) * 0x1.0p-53;
+}
+
+static void name_tld(struct tld *t, long i) {
+    char digits[16];
+    int n = 0;
+
+    if (i < (long)(sizeof(real) / sizeof(real[0]))) {
+        strcpy(t->name, real[i]);
+    } else {
+        i -= sizeof(real) / sizeof(real[0]);
+        do {
+            digits[n++] = 'a' + i % 26;
+            i /= 26;
+        } while (i > 0);
+        t->name[0] = 'x';
+        for (int j = 0; j < n; j++)
+            t->name[j + 1] = digits[n - 1 - j];
+        t->name[n + 1] = '\0';
+    }
+    t->len = strlen(t->name);
+    t->count = 0;
+}
+
+/* the index of the first cumulative weight above `u' */
+static long pick(const double *cdf, long k, double u) {
+    long lo = 0, hi = k - 1;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (cdf[mid] > u)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+static int by_count(const void *a, const void *b) {
+    const struct tld *t1 = a, *t2 = b;
+    if (t1->count != t2->count)
+        return (t1->count < t2->count) ? -1 : 1;
+    return strcmp(t1->name, t2->name);
+}
+
+static int write_reference(const char *path, struct tld *tlds, long k, long total) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    qsort(tlds, k, sizeof(struct tld), by_count);
+    for (long i = 0; i < k; i++)
+        if (tlds[i].count > 0)
+            fprintf(fp, "%6.2f %s %ld\n", 100.0 * (double)tlds[i].count / (double)total, tlds[i].name, tlds[i].count);
+    return fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+    long lines = 1000000, k = 250, day0, span, i;
+    double skew = 1.0, ordered = 0.0, *cdf;
+    char *first = "01/01/2015", *last = "31/12/2020", *reference = NULL;
+    uint32_t begin, end, date;
+    struct tld *tlds;
+    char *buf;
+    size_t len = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:k:s:b:e:o:S:r:")) != -1) {
+        switch (opt) {
+        case 'n': lines = atol(optarg); break;
+        case 'k': k = atol(optarg); break;
+        case 's': skew = atof(optarg); break;
+        case 'b': first = optarg; break;
+        case 'e': last = optarg; break;
+        case 'o': ordered = atof(optarg); break;
+        case 'S': state = strtoull(optarg, NULL, 0) | 1; break;
+        case 'r': reference = optarg; break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return -1;
+        }
+    }
+    if (lines < 1 || k < 1 || skew < 0 || ordered < 0 || ordered > 1 ||
+        strlen(first) != 10 || strlen(last) != 10 ||
+        !date_parse_packed(first, &begin) || !date_parse_packed(last, &end) || begin > end) {
+        fprintf(stderr, USAGE, argv[0]);
+        return -1;
+    }
+    day0 = date_days(begin);
+    span = date_days(end) - day0 + 1;
+
+    tlds = malloc(k * sizeof(struct tld));
+    cdf = malloc(k * sizeof(double));
+    buf = malloc(OUTBUF);
+    if (tlds == NULL || cdf == NULL || buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    // Zipf: the TLD of rank r is drawn with weight 1 / r^skew
+    for (i = 0; i < k; i++) {
+        name_tld(&tlds[i], i);
+        cdf[i] = ((i > 0) ? cdf[i - 1] : 0.0) + pow((double)(i + 1), -skew);
+    }
+    for (i = 0; i < k; i++)
+        cdf[i] /= cdf[k - 1];
+
+    // `ordered' of the lines follow the clock through the window, the rest are scattered over it
+    for (i = 0; i < lines; i++) {
+        long day = (uniform() < ordered) ? (long)((double)i / lines * span) : (long)(next() % span);
+        struct tld *t = &tlds[pick(cdf, k, uniform())];
+        int hostlen = 2 + next() % 9;
+
+        if (len + 64 > OUTBUF) {
+            fwrite(buf, 1, len, stdout);
+            len = 0;
+        }
+        date = date_from_days(day0 + day);
+        len += sprintf(buf + len, "%02u/%02u/%04u www.", date % 100, date / 100 % 100, date / 10000);
+        for (int j = 0; j < hostlen; j++)
+            buf[len++] = 'a' + next() % 26;
+        buf[len++] = '.';
+        memcpy(buf + len, t->name, t->len);
+        len += t->len;
+        buf[len++] = '\n';
+        t->count++;
+    }
+    fwrite(buf, 1, len, stdout);
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "Unable to write log\n");
+        return -1;
+    }
+    if (reference != NULL && write_reference(reference, tlds, k, lines) != 0) {
+        fprintf(stderr, "Unable to write %s\n", reference);
+        return -1;
+    }
+    free(buf);
+    free(cdf);
+    free(tlds);
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * gentld reads the list of known TLDs (tlds.txt) and writes tldtable.c to
+ * stdout: a perfect hash table over them, so that tldtable_find() costs one
+ * hash of the name and one comparison whether or not the TLD is known
+ *
+ * the table is hash-and-displace: the top bits of a key's FNV-1a hash pick
+ * its bucket, and each bucket has a seed, found here, that scatters the keys
+ * in it into slots no other key uses; filling the biggest buckets first
+ * leaves plenty of room for the small ones
+ */
+
+#define USAGE "usage: %s list\n"
+#define LONGEST 63              // A DNS label is at most 63 bytes
+#define KEYS_PER_BUCKET 4
+#define MAX_LOAD 0.75           // Of the slots, by keys
+#define MAX_SEED (1UL << 24)
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define MIX 0x9E3779B97F4A7C15ULL
+
+struct key {
+    char *name;
+    size_t len;
+    unsigned long long hash;
+    unsigned long bucket;
+};
+
+struct bucket {
+    unsigned long index;
+    long *keys;                 // Indices into the key array
+    long n;
+};
+
+/* the generated lookup, which has to hash exactly as hash() below does */
+static const char lookup[] =
+    "// ASCII letters are folded to lower case, as the names in the table are\n"
+    "long tldtable_find(const char *name, size_t len) {\n"
+    "    unsigned long long hash = FNV_OFFSET;\n"
+    "    if (len == 0 || len > LONGEST) { return -1; }\n"
+    "    for (size_t i = 0; i < len; i++) {\n"
+    "        hash ^= LOGLINE_FOLD(name[i]);\n"
+    "        hash *= FNV_PRIME;\n"
+    "    }\n"
+    "    long index = slots[((hash ^ seeds[hash >> (64 - BUCKET_BITS)]) * MIX) >> (64 - SLOT_BITS)];\n"
+    "    if (index < 0 || lengths[index] != len) { return -1; }\n"
+    "    for (size_t i = 0; i < len; i++) {\n"
+    "        if (LOGLINE_FOLD(name[i]) != (unsigned char) names[index][i]) { return -1; }\n"
+    "    }\n"
+    "    return index;\n"
+    "}\n"
+    "\n"
+    "const char *tldtable_name(long index) {\n"
+    "    return names[index];\n"
+    "}\n";
+
+static unsigned long long hash(const char *s, size_t len) {
+    unsigned long long h = FNV_OFFSET;
+    while (len-- > 0) {
+        h ^= (unsigned char) *s++;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static unsigned long slot_of(unsigned long long h, unsigned long seed, int slot_bits) {
+    return ((h ^ seed) * MIX) >> (64 - slot_bits);
+}
+
+static int by_size(const void *a, const void *b) {
+    const struct bucket *b1 = a, *b2 = b;
+    if (b1->n != b2->n)
+        return (b1->n > b2->n) ? -1 : 1;
+    return (b1->index < b2->index) ? -1 : 1;
+}
+
+/* reads the list, checking each name is a lower case label; returns the number of keys, -1 on error */
+static long read_keys(const char *path, struct key **out) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    long n = 0, cap = 0, lineno = 0;
+    struct key *keys = NULL;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        lineno++;
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
+        if (len > LONGEST || strspn(line, "abcdefghijklmnopqrstuvwxyz0123456789-") != len) {
+            fprintf(stderr, "%s:%ld: not a lower case TLD: %s\n", path, lineno, line);
+            fclose(fp);
+            return -1;
+        }
+        if (n == cap) {
+            cap = (cap == 0) ? 1024 : cap * 2;
+            keys = realloc(keys, cap * sizeof(struct key));
+            if (keys == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                fclose(fp);
+                return -1;
+            }
+        }
+        keys[n].name = strdup(line);
+        keys[n].len = len;
+        keys[n].hash = hash(line, len);
+        if (keys[n].name == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            fclose(fp);
+            return -1;
+        }
+        n++;
+    }
+    fclose(fp);
+    if (n == 0) {
+        fprintf(stderr, "%s: no TLDs\n", path);
+        return -1;
+    }
+    *out = keys;
+    return n;
+}
+
+/* finds a seed for every bucket; returns 0 if some bucket has none */
+static int place(struct key *keys, struct bucket *buckets, unsigned long nbuckets,
+                 unsigned long *seeds, long *slots, int slot_bits) {
+    unsigned long nslots = 1UL << slot_bits;
+    unsigned long *tried;
+    long most = 0;
+
+    for (unsigned long b = 0; b < nbuckets; b++)
+        if (buckets[b].n > most)
+            most = buckets[b].n;
+    tried = malloc(most * sizeof(unsigned long));
+    if (tried == NULL)
+        return 0;
+    for (unsigned long s = 0; s < nslots; s++)
+        slots[s] = -1;
+    qsort(buckets, nbuckets, sizeof(struct bucket), by_size);
+
+    for (unsigned long b = 0; b < nbuckets && buckets[b].n > 0; b++) {
+        struct bucket *bk = &buckets[b];
+        unsigned long seed;
+        for (seed = 0; seed < MAX_SEED; seed++) {
+            long i, j;
+            for (i = 0; i < bk->n; i++) {
+                tried[i] = slot_of(keys[bk->keys[i]].hash, seed, slot_bits);
+                if (slots[tried[i]] >= 0)
+                    break;
+                for (j = 0; j < i && tried[j] != tried[i]; j++)
+                    ;
+                if (j < i)
+                    break;
+            }
+            if (i == bk->n)
+                break;
+        }
+        if (seed == MAX_SEED) {
+            free(tried);
+            return 0;
+        }
+        seeds[bk->index] = seed;
+        for (long i = 0; i < bk->n; i++)
+            slots[tried[i]] = bk->keys[i];
+    }
+    free(tried);
+    return 1;
+}
+
+static void write_table(struct key *keys, long n, unsigned long *seeds, int bucket_bits,
+                        long *slots, int slot_bits, const char *path) {
+    size_t longest = 0;
+
+    for (long i = 0; i < n; i++)
+        if (keys[i].len > longest)
+            longest = keys[i].len;
+
+    printf("// Generated by gentld from %s: edit the list, not this file\n\n", path);
+    printf("#include <stddef.h>\n#include <stdint.h>\n#include \"logline.h\"\n#include \"tldtable.h\"\n\n");
+    printf("#define BUCKET_BITS %d\n#define SLOT_BITS %d\n#define LONGEST %zu\n", bucket_bits, slot_bits, longest);
+    printf("#define FNV_OFFSET %lluULL\n#define FNV_PRIME %lluULL\n#define MIX 0x%llXULL\n\n",
+           FNV_OFFSET, FNV_PRIME, MIX);
+    printf("const long tldtable_size = %ld;\n\n", n);
+
+    printf("static const char *const names[%ld] = {", n);
+    for (long i = 0; i < n; i++)
+        printf("%s\"%s\",", (i % 8 == 0) ? "\n    " : " ", keys[i].name);
+    printf("\n};\n\n");
+
+    printf("static const uint8_t lengths[%ld] = {", n);
+    for (long i = 0; i < n; i++)
+        printf("%s%zu,", (i % 16 == 0) ? "\n    " : " ", keys[i].len);
+    printf("\n};\n\n");
+
+    printf("static const uint32_t seeds[%lu] = {", 1UL << bucket_bits);
+    for (unsigned long b = 0; b < (1UL << bucket_bits); b++)
+        printf("%s%lu,", (b % 12 == 0) ? "\n    " : " ", seeds[b]);
+    printf("\n};\n\n");
+
+    // The index of the key in each slot, -1 for an empty one
+    printf("static const int16_t slots[%lu] = {", 1UL << slot_bits);
+    for (unsigned long s = 0; s < (1UL << slot_bits); s++)
+        printf("%s%ld,", (s % 16 == 0) ? "\n    " : " ", slots[s]);
+    printf("\n};\n\n%s", lookup);
+}
+
+int main(int argc, char *argv[]) {
+    struct key *keys;
+    struct bucket *buckets;
+    unsigned long nbuckets, *seeds;
+    long n, *slots, *members;
+    int bucket_bits = 1, slot_bits = 1;
+
+    if (argc != 2) {
+        fprintf(stderr, USAGE, argv[0]);
+        return -1;
+    }
+    n = read_keys(argv[1], &keys);
+    if (n < 0)
+        return -1;
+    if (n > 32767) {
+        fprintf(stderr, "%s: too many TLDs for the table\n", argv[1]);
+        return -1;
+    }
+    while ((1L << bucket_bits) * KEYS_PER_BUCKET < n)
+        bucket_bits++;
+    while ((1L << slot_bits) * MAX_LOAD < n)
+        slot_bits++;
+    nbuckets = 1UL << bucket_bits;
+
+    buckets = calloc(nbuckets, sizeof(struct bucket));
+    seeds = calloc(nbuckets, sizeof(unsigned long));
+    slots = malloc((1UL << slot_bits) * sizeof(long));
+    members = malloc(n * sizeof(long));
+    if (buckets == NULL || seeds == NULL || slots == NULL || members == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    // Lay each bucket's keys out contiguously, counting them first
+    for (long i = 0; i < n; i++) {
+        keys[i].bucket = keys[i].hash >> (64 - bucket_bits);
+        buckets[keys[i].bucket].n++;
+    }
+    for (unsigned long b = 0, at = 0; b < nbuckets; b++) {
+        buckets[b].index = b;
+        buckets[b].keys = members + at;
+        at += buckets[b].n;
+        buckets[b].n = 0;
+    }
+    for (long i = 0; i < n; i++) {
+        struct bucket *bk = &buckets[keys[i].bucket];
+        // Two keys with one hash can never be told apart, which is all a duplicate is
+        for (long j = 0; j < bk->n; j++) {
+            if (keys[bk->keys[j]].hash == keys[i].hash) {
+                fprintf(stderr, "%s: %s and %s hash alike\n", argv[1], keys[bk->keys[j]].name, keys[i].name);
+                return -1;
+            }
+        }
+        bk->keys[bk->n++] = i;
+    }
+
+    if (!place(keys, buckets, nbuckets, seeds, slots, slot_bits)) {
+        fprintf(stderr, "%s: no perfect hash found\n", argv[1]);
+        return -1;
+    }
+    write_table(keys, n, seeds, bucket_bits, slots, slot_bits, argv[1]);
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "Unable to write table\n");
+        return -1;
+    }
+    for (long i = 0; i < n; i++)
+        free(keys[i].name);
+    free(keys);
+    free(buckets);
+    free(seeds);
+    free(slots);
+    free(members);
+    return 0;
+}
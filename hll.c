@@ -0,0 +1,58 @@
+#include <math.h>
+#include "hll.h"
+#include "logline.h"
+
+// Macros and Enumerations
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define HLL_ALPHA (0.7213 / (1.0 + 1.079 / HLL_REGISTERS))  // Bias correction for large m
+#define HLL_LINEAR (2.5 * HLL_REGISTERS)                    // Below this, count empty registers
+
+// FNV-1a of the lower-cased bytes, then the MurmurHash3 finaliser: HyperLogLog
+// reads the top bits for the register and the rest for the run of zeros, and
+// plain FNV-1a leaves both too poorly mixed for short strings
+uint64_t hll_hash(const char *s, size_t len) {
+    uint64_t h = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        h ^= LOGLINE_FOLD(s[i]);
+        h *= FNV_PRIME;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void hll_add(uint8_t *registers, uint64_t hash) {
+    // The first HLL_PRECISION bits pick the register, which keeps the longest
+    // run of leading zeros (plus one) seen in the bits after them
+    uint32_t index = hash >> (64 - HLL_PRECISION);
+    uint64_t rest = hash << HLL_PRECISION;
+    uint8_t rank = (rest == 0) ? 64 - HLL_PRECISION + 1 : __builtin_clzll(rest) + 1;
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
+
+void hll_merge(uint8_t *dst, const uint8_t *src) {
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (src[i] > dst[i]) { dst[i] = src[i]; }
+    }
+}
+
+long hll_estimate(const uint8_t *registers) {
+    double sum = 0.0;
+    int zeros = 0;
+
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += (registers[i] == 0);
+    }
+    double estimate = HLL_ALPHA * HLL_REGISTERS * HLL_REGISTERS / sum;
+    if (estimate <= HLL_LINEAR && zeros > 0) {
+        estimate = HLL_REGISTERS * log((double) HLL_REGISTERS / zeros);
+    }
+    return (long) (estimate + 0.5);
+}
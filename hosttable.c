@@ -0,0 +1,523 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hosttable.h"
+#include "logline.h"
+#include "mem.h"
+
+// Macros and Enumerations
+#define HOST_MAX LOGLINE_MAX    // No hostname is longer than the line it came in
+
+// Spilled records keep each name's length in 16 bits
+_Static_assert(HOST_MAX <= UINT16_MAX, "hostnames too long for a spilled run");
+#define POOL_INITIAL (1 << 16)  // Bytes, more than HOST_MAX so a spilled table always has room
+#define ENTRIES_INITIAL 1024
+#define SLOTS_INITIAL 2048      // A power of two, at least twice the entries
+#define MAX_RUNS 64             // Runs merged into one before there are more
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// Definitions for each structure
+struct hostentry {
+    uint32_t name;              // Offset of the NUL-terminated name in the pool
+    uint32_t hash;
+    long count;
+};
+
+struct hostrun {
+    FILE *fp;                   // Records of a 16-bit length, the name, then its count
+    struct hostrun *next;
+};
+
+struct hosttable {
+    size_t max_mem;             // 0 for no limit
+    int by_count;               // Runs are in count order, see hosttable_cursor
+    char *pool;
+    size_t pool_used;
+    size_t pool_cap;
+    struct hostentry *entries;
+    uint32_t n;
+    uint32_t cap;
+    uint32_t *slots;            // Entry number plus one, 0 for an empty slot
+    uint32_t nslots;
+    struct hostrun *runs;
+    int nruns;
+};
+
+// One sorted stream for the cursor to merge: a run, or the table's own entries
+struct hostsource {
+    FILE *fp;                   // NULL for the table's entries
+    uint32_t next;              // The next of those entries
+    const char *name;           // Current name, in buf or the pool
+    long count;
+    char buf[HOST_MAX + 1];
+};
+
+struct hostcursor {
+    HostTable *t;
+    HostTable *sorted;          // A count-ordered copy of a spilled table, owned by the cursor
+    int by_count;
+    struct hostsource *sources;
+    int *heap;                  // Sources with a current name, the least on top
+    int nheap;
+    int error;
+    char name[HOST_MAX + 1];
+};
+
+// The pool the entries being sorted point into, qsort has no room for it
+static __thread const char *sort_pool;
+
+// File Specific Prototypes
+static int table_room(HostTable *t, size_t len);
+static int table_spill(HostTable *t);
+static int table_compact(HostTable *t);
+static void table_clear(HostTable *t);
+static void table_release(HostTable *t);
+static size_t table_bytes(size_t pool_cap, size_t cap, size_t nslots);
+static struct hostrun *run_create(void);
+static void run_write(struct hostrun *run, const char *name, long count);
+static int run_finish(HostTable *t, struct hostrun *run);
+static void runs_close(struct hostrun *run);
+static int entry_by_name(const void *a, const void *b);
+static int entry_by_count(const void *a, const void *b);
+static int source_advance(HostCursor *c, struct hostsource *s);
+static int source_less(HostCursor *c, int a, int b);
+static void heap_sift_down(HostCursor *c, int i);
+static uint32_t hosthash(const char *s, size_t len);
+static int host_match(const char *stored, const char *host, size_t len);
+
+HostTable *hosttable_create(size_t max_mem) {
+    HostTable *t;
+
+    if (max_mem != 0 && max_mem < HOSTTABLE_MIN_MEM) { return NULL; }
+    t = (HostTable *) mem_calloc(1, sizeof(HostTable));
+    if (t == NULL) { return NULL; }
+    t->max_mem  = max_mem;
+    t->pool     = (char *) mem_malloc(POOL_INITIAL);
+    t->entries  = (struct hostentry *) mem_malloc(ENTRIES_INITIAL * sizeof(struct hostentry));
+    t->slots    = (uint32_t *) mem_calloc(SLOTS_INITIAL, sizeof(uint32_t));
+    t->pool_cap = POOL_INITIAL;
+    t->cap      = ENTRIES_INITIAL;
+    t->nslots   = SLOTS_INITIAL;
+    if (t->pool == NULL || t->entries == NULL || t->slots == NULL) {
+        hosttable_destroy(t);
+        return NULL;
+    }
+    return t;
+}
+
+void hosttable_destroy(HostTable *t) {
+    runs_close(t->runs);
+    if (t->pool != NULL) { mem_free(t->pool); }
+    if (t->entries != NULL) { mem_free(t->entries); }
+    if (t->slots != NULL) { mem_free(t->slots); }
+    mem_free(t);
+}
+
+int hosttable_add(HostTable *t, const char *host, size_t len, long count) {
+    uint32_t hash, mask = t->nslots - 1, i;
+    struct hostentry *e;
+
+    if (len > HOST_MAX) { return 0; }
+    hash = hosthash(host, len);
+    for (i = hash & mask; t->slots[i] != 0; i = (i + 1) & mask) {
+        e = &t->entries[t->slots[i] - 1];
+        if (e->hash == hash && host_match(t->pool + e->name, host, len)) {
+            e->count += count;
+            return 1;
+        }
+    }
+
+    // A new name: grow to make room for it, or spill everything and start again
+    switch (table_room(t, len)) {
+    case 0:
+        if (!table_spill(t)) { return 0; }
+        break;
+    case -1:
+        return 0;
+    }
+    mask = t->nslots - 1;
+    for (i = hash & mask; t->slots[i] != 0; i = (i + 1) & mask) {
+        ;
+    }
+
+    e = &t->entries[t->n];
+    e->name  = t->pool_used;
+    e->hash  = hash;
+    e->count = count;
+    for (size_t j = 0; j < len; j++) { t->pool[t->pool_used++] = LOGLINE_FOLD(host[j]); }
+    t->pool[t->pool_used++] = '\0';
+    t->slots[i] = ++t->n;
+    return 1;
+}
+
+int hosttable_merge(HostTable *dst, HostTable *src) {
+    for (uint32_t i = 0; i < src->n; i++) {
+        const char *name = src->pool + src->entries[i].name;
+        if (!hosttable_add(dst, name, strlen(name), src->entries[i].count)) { return 0; }
+    }
+    table_clear(src);
+    while (src->runs != NULL) {
+        struct hostrun *run = src->runs;
+        src->runs = run->next;
+        run->next = dst->runs;
+        dst->runs = run;
+    }
+    dst->nruns += src->nruns;
+    src->nruns = 0;
+    return (dst->nruns < MAX_RUNS) ? 1 : table_compact(dst);
+}
+
+int hosttable_runs(HostTable *t) {
+    return t->nruns;
+}
+
+// Returns 1 if there is room for one more name of `len' bytes, growing the
+// table if it has to; 0 if growing would break the limit (or the 32-bit
+// offsets), so the table must spill; -1 if an allocation failed
+static int table_room(HostTable *t, size_t len) {
+    size_t pool_cap = t->pool_cap, cap = t->cap, nslots = t->nslots;
+
+    while (t->pool_used + len + 1 > pool_cap) { pool_cap *= 2; }
+    if (t->n == cap) { cap *= 2; }
+    if (2 * ((size_t) t->n + 1) > nslots) { nslots *= 2; }
+    if (pool_cap == t->pool_cap && cap == t->cap && nslots == t->nslots) { return 1; }
+    if (pool_cap > UINT32_MAX || cap > UINT32_MAX / 2 || nslots > UINT32_MAX) { return 0; }
+    // The old index is still held while the new one is filled
+    if (t->max_mem > 0 && table_bytes(pool_cap, cap, nslots) +
+                          (nslots != t->nslots ? t->nslots * sizeof(uint32_t) : 0) > t->max_mem) {
+        return 0;
+    }
+
+    if (pool_cap != t->pool_cap) {
+        char *pool = (char *) mem_realloc(t->pool, pool_cap);
+        if (pool == NULL) { return -1; }
+        t->pool = pool;
+        t->pool_cap = pool_cap;
+    }
+    if (cap != t->cap) {
+        struct hostentry *entries = (struct hostentry *) mem_realloc(t->entries, cap * sizeof(struct hostentry));
+        if (entries == NULL) { return -1; }
+        t->entries = entries;
+        t->cap = cap;
+    }
+    if (nslots != t->nslots) {
+        // Re-place every entry from its stored hash, without touching the names
+        uint32_t *slots = (uint32_t *) mem_calloc(nslots, sizeof(uint32_t));
+        if (slots == NULL) { return -1; }
+        for (uint32_t k = 0; k < t->n; k++) {
+            uint32_t i = t->entries[k].hash & (nslots - 1);
+            while (slots[i] != 0) { i = (i + 1) & (nslots - 1); }
+            slots[i] = k + 1;
+        }
+        mem_free(t->slots);
+        t->slots = slots;
+        t->nslots = nslots;
+    }
+    return 1;
+}
+
+// Writes the table's entries to a new run in its order and empties it,
+// keeping the memory it has for what comes next
+static int table_spill(HostTable *t) {
+    struct hostrun *run;
+
+    if (t->n == 0) { return 1; }
+    sort_pool = t->pool;
+    qsort(t->entries, t->n, sizeof(struct hostentry), t->by_count ? entry_by_count : entry_by_name);
+    run = run_create();
+    if (run == NULL) { return 0; }
+    for (uint32_t i = 0; i < t->n; i++) {
+        run_write(run, t->pool + t->entries[i].name, t->entries[i].count);
+    }
+    if (!run_finish(t, run)) { return 0; }
+    table_clear(t);
+
+    // Each run holds a file open until the end, so merge them before there are too many
+    return (t->nruns < MAX_RUNS) ? 1 : table_compact(t);
+}
+
+// Merges every run and the table's own entries into one run, emptying the table
+static int table_compact(HostTable *t) {
+    HostCursor *c = hosttable_cursor(t, t->by_count);
+    struct hostrun *run = run_create(), *old = t->runs;
+    const char *name;
+    long count;
+    int got = -1, nruns = t->nruns;
+
+    if (c != NULL && run != NULL) {
+        while ((got = hostcursor_next(c, &name, &count)) == 1) { run_write(run, name, count); }
+    }
+    if (c != NULL) { hostcursor_destroy(c); }
+    if (got < 0) {
+        runs_close(run);
+        return 0;
+    }
+    t->runs = NULL;
+    t->nruns = 0;
+    if (!run_finish(t, run)) {
+        t->runs = old;
+        t->nruns = nruns;
+        return 0;
+    }
+    runs_close(old);
+    table_clear(t);
+    return 1;
+}
+
+static void table_clear(HostTable *t) {
+    t->n = 0;
+    t->pool_used = 0;
+    memset(t->slots, 0, t->nslots * sizeof(uint32_t));
+}
+
+// Frees the pool, entries and index of a table that is empty and will only
+// be read back, from its runs, and destroyed
+static void table_release(HostTable *t) {
+    mem_free(t->pool);
+    mem_free(t->entries);
+    mem_free(t->slots);
+    t->pool = NULL;
+    t->entries = NULL;
+    t->slots = NULL;
+    t->pool_cap = t->cap = t->nslots = 0;
+}
+
+static size_t table_bytes(size_t pool_cap, size_t cap, size_t nslots) {
+    return pool_cap + cap * sizeof(struct hostentry) + nslots * sizeof(uint32_t);
+}
+
+/*
+/
+/ Run Implementation
+/
+*/
+
+static struct hostrun *run_create(void) {
+    struct hostrun *run = (struct hostrun *) mem_malloc(sizeof(struct hostrun));
+    if (run == NULL) { return NULL; }
+    run->fp = tmpfile();
+    run->next = NULL;
+    if (run->fp == NULL) {
+        mem_free(run);
+        return NULL;
+    }
+    return run;
+}
+
+static void run_write(struct hostrun *run, const char *name, long count) {
+    uint16_t len = strlen(name);
+    fwrite(&len, sizeof(len), 1, run->fp);
+    fwrite(name, 1, len, run->fp);
+    fwrite(&count, sizeof(long), 1, run->fp);
+}
+
+// Adds the written `run' to the table, or throws it away if it could not be written
+static int run_finish(HostTable *t, struct hostrun *run) {
+    if (fflush(run->fp) != 0 || ferror(run->fp)) {
+        runs_close(run);
+        return 0;
+    }
+    run->next = t->runs;
+    t->runs = run;
+    t->nruns++;
+    return 1;
+}
+
+// Closes, so deletes, `run' and every run after it
+static void runs_close(struct hostrun *run) {
+    while (run != NULL) {
+        struct hostrun *next = run->next;
+        fclose(run->fp);
+        mem_free(run);
+        run = next;
+    }
+}
+
+static int entry_by_name(const void *a, const void *b) {
+    const struct hostentry *e1 = a, *e2 = b;
+    return strcmp(sort_pool + e1->name, sort_pool + e2->name);
+}
+
+// As tldentry_by_count orders a report: ascending count, ties by name
+static int entry_by_count(const void *a, const void *b) {
+    const struct hostentry *e1 = a, *e2 = b;
+    if (e1->count != e2->count) {
+        return (e1->count < e2->count) ? -1 : 1;
+    }
+    return strcmp(sort_pool + e1->name, sort_pool + e2->name);
+}
+
+/*
+/
+/ HostCursor Implementation
+/
+*/
+
+HostCursor *hosttable_cursor(HostTable *t, int by_count) {
+    HostCursor *c;
+    int i = 0;
+
+    // Runs sorted by name can only be merged by name: do that into a second
+    // table whose runs are sorted by count, and read it; `t' is all in runs
+    // by then, and gives up its memory so that the two stay within the limit
+    if (by_count && !t->by_count && t->runs != NULL) {
+        HostTable *sorted = NULL;
+        HostCursor *names = NULL;
+        const char *name;
+        long count;
+        int got = -1;
+
+        if (table_spill(t)) {
+            table_release(t);
+            sorted = hosttable_create(t->max_mem);
+        }
+        if (sorted != NULL && (names = hosttable_cursor(t, 0)) != NULL) {
+            sorted->by_count = 1;
+            while ((got = hostcursor_next(names, &name, &count)) == 1) {
+                if (!hosttable_add(sorted, name, strlen(name), count)) {
+                    got = -1;
+                    break;
+                }
+            }
+        }
+        if (names != NULL) { hostcursor_destroy(names); }
+        c = (got == 0) ? hosttable_cursor(sorted, 1) : NULL;
+        if (c == NULL) {
+            if (sorted != NULL) { hosttable_destroy(sorted); }
+            return NULL;
+        }
+        c->sorted = sorted;
+        return c;
+    }
+
+    c = (HostCursor *) mem_calloc(1, sizeof(HostCursor));
+    if (c == NULL) { return NULL; }
+    c->t = t;
+    c->by_count = by_count;
+    c->sources = (struct hostsource *) mem_malloc((t->nruns + 1) * sizeof(struct hostsource));
+    c->heap = (int *) mem_malloc((t->nruns + 1) * sizeof(int));
+    if (c->sources == NULL || c->heap == NULL) {
+        hostcursor_destroy(c);
+        return NULL;
+    }
+
+    // The table's own entries are one more sorted stream beside the runs
+    sort_pool = t->pool;
+    if (t->n > 0) { qsort(t->entries, t->n, sizeof(struct hostentry), by_count ? entry_by_count : entry_by_name); }
+    c->sources[0].fp = NULL;
+    c->sources[0].next = 0;
+    for (struct hostrun *run = t->runs; run != NULL; run = run->next) {
+        c->sources[++i].fp = run->fp;
+        rewind(run->fp);
+    }
+    for (i = 0; i <= t->nruns; i++) {
+        int got = source_advance(c, &c->sources[i]);
+        if (got < 0) {
+            hostcursor_destroy(c);
+            return NULL;
+        }
+        if (got > 0) { c->heap[c->nheap++] = i; }
+    }
+    for (i = c->nheap / 2 - 1; i >= 0; i--) { heap_sift_down(c, i); }
+    return c;
+}
+
+int hostcursor_next(HostCursor *c, const char **name, long *count) {
+    long total = 0;
+
+    if (c->error) { return -1; }
+    if (c->nheap == 0) { return 0; }
+    strcpy(c->name, c->sources[c->heap[0]].name);
+
+    // By name, the same host can come from several runs: they leave the heap together
+    do {
+        struct hostsource *s = &c->sources[c->heap[0]];
+        int got;
+        total += s->count;
+        got = source_advance(c, s);
+        if (got < 0) {
+            c->error = 1;
+            return -1;
+        }
+        if (got == 0) { c->heap[0] = c->heap[--c->nheap]; }
+        heap_sift_down(c, 0);
+    } while (!c->by_count && c->nheap > 0 && strcmp(c->sources[c->heap[0]].name, c->name) == 0);
+    *name = c->name;
+    *count = total;
+    return 1;
+}
+
+void hostcursor_destroy(HostCursor *c) {
+    if (c->sorted != NULL) { hosttable_destroy(c->sorted); }
+    if (c->sources != NULL) { mem_free(c->sources); }
+    if (c->heap != NULL) { mem_free(c->heap); }
+    mem_free(c);
+}
+
+// Moves `s' on to its next name; returns 1 if there was one, 0 at the end, -1 on a read error
+static int source_advance(HostCursor *c, struct hostsource *s) {
+    uint16_t len;
+
+    if (s->fp == NULL) {
+        if (s->next == c->t->n) { return 0; }
+        s->name  = c->t->pool + c->t->entries[s->next].name;
+        s->count = c->t->entries[s->next++].count;
+        return 1;
+    }
+    if (fread(&len, sizeof(len), 1, s->fp) != 1) {
+        return ferror(s->fp) ? -1 : 0;
+    }
+    if (len > HOST_MAX || fread(s->buf, 1, len, s->fp) != len || fread(&s->count, sizeof(long), 1, s->fp) != 1) {
+        return -1;
+    }
+    s->buf[len] = '\0';
+    s->name = s->buf;
+    return 1;
+}
+
+static int source_less(HostCursor *c, int a, int b) {
+    struct hostsource *s1 = &c->sources[a], *s2 = &c->sources[b];
+    if (c->by_count && s1->count != s2->count) {
+        return s1->count < s2->count;
+    }
+    return strcmp(s1->name, s2->name) < 0;
+}
+
+static void heap_sift_down(HostCursor *c, int i) {
+    for (;;) {
+        int least = i, l = 2 * i + 1, r = 2 * i + 2, tmp;
+        if (l < c->nheap && source_less(c, c->heap[l], c->heap[least])) { least = l; }
+        if (r < c->nheap && source_less(c, c->heap[r], c->heap[least])) { least = r; }
+        if (least == i) { return; }
+        tmp = c->heap[i];
+        c->heap[i] = c->heap[least];
+        c->heap[least] = tmp;
+        i = least;
+    }
+}
+
+/*
+/
+/ String Implementation
+/
+*/
+
+// FNV-1a over the lower-cased key, folded to 32 bits
+static uint32_t hosthash(const char *s, size_t len) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= LOGLINE_FOLD(s[i]);
+        hash *= FNV_PRIME;
+    }
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+// Compares a stored, lower-cased name with the `len' bytes at `host'
+static int host_match(const char *stored, const char *host, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (stored[i] == '\0' || (unsigned char) stored[i] != LOGLINE_FOLD(host[i])) { return 0; }
+    }
+    return stored[len] == '\0';
+}
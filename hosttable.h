@@ -0,0 +1,76 @@
+#ifndef _HOSTTABLE_H_INCLUDED_
+#define _HOSTTABLE_H_INCLUDED_
+
+#include <stddef.h>
+
+typedef struct hosttable HostTable;
+typedef struct hostcursor HostCursor;
+
+/*
+ * a HostTable counts full hostnames, folded to lower case, of which there
+ * can be millions: the names are packed end to end in one string pool,
+ * and a hash index of 32-bit entry numbers finds them, so a hostname costs
+ * its own bytes plus about 24 more
+ *
+ * given a memory limit, a table that would grow past it instead sorts what
+ * it holds by name, spills it to a temporary file as a run, and starts
+ * again empty; reading the table back merges the runs, so the counts are
+ * exact however many spills there were
+ */
+
+/*
+ * hosttable_create creates an empty table that keeps its pool, entries and
+ * index within `max_mem' bytes, spilling when it cannot; a `max_mem' of 0
+ * means no limit, and any other value must be at least HOSTTABLE_MIN_MEM
+ * returns a pointer to the table if successful, NULL if not
+ */
+#define HOSTTABLE_MIN_MEM (1L << 20)
+HostTable *hosttable_create(size_t max_mem);
+
+/*
+ * hosttable_destroy frees the table and closes (so deletes) its runs
+ */
+void hosttable_destroy(HostTable *t);
+
+/*
+ * hosttable_add counts the hostname in the `len' bytes at `host' (which
+ * need not be NUL-terminated) `count' times
+ * returns 1 if successful, 0 if not (memory allocation or spill failure,
+ * or a name longer than a log line)
+ */
+int hosttable_add(HostTable *t, const char *host, size_t len, long count);
+
+/*
+ * hosttable_merge adds everything counted in `src' to `dst', taking over
+ * its runs; `src' is left empty
+ * returns 1 if successful, 0 if not
+ */
+int hosttable_merge(HostTable *dst, HostTable *src);
+
+/*
+ * hosttable_runs returns the number of runs the table has spilled
+ */
+int hosttable_runs(HostTable *t);
+
+/*
+ * hosttable_cursor starts reading back every hostname and its total count,
+ * in name order, or by ascending count (ties by name) if `by_count' is set;
+ * the table can only be destroyed after that, not added to, and only one
+ * cursor may be open on it at a time
+ * returns a pointer to the cursor if successful, NULL if not
+ */
+HostCursor *hosttable_cursor(HostTable *t, int by_count);
+
+/*
+ * hostcursor_next sets `*name', valid until the next call, and `*count' to
+ * the next hostname and its count
+ * returns 1 if it did, 0 at the end, -1 if a run could not be read
+ */
+int hostcursor_next(HostCursor *c, const char **name, long *count);
+
+/*
+ * hostcursor_destroy destroys the cursor `c'
+ */
+void hostcursor_destroy(HostCursor *c);
+
+#endif /* _HOSTTABLE_H_INCLUDED_ */
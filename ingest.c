@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <string.h>
+#include "ingest.h"
+#include "scan.h"
+#include "date.h"
+#include "stats.h"
+
+// Macros and Enumerations
+#define SCANBATCH 256
+#define PROBES 256              // Lines sampled across a log to check it is sorted
+
+// File Specific Prototypes
+static inline size_t ingest_run(TLDList *tld, const char *buf, size_t len, int final,
+                                const char **bad, unsigned long *lines, uint32_t *last);
+static inline void check_order(uint32_t *last, uint32_t date);
+static const char *first_dated(const char *lo, const char *hi, const char *limit, uint32_t key);
+static const char *line_after(const char *p, const char *lo, const char *hi);
+static const char *line_before(const char *p, const char *lo);
+static uint32_t dated_from(const char *p, const char *hi);
+static const char *next_line(const char *p, const char *hi);
+static void count_fields(TLDList *tld, const char *date, size_t datelen, const char *host, size_t hostlen,
+                         size_t tldlen, uint32_t *last);
+
+size_t ingest_lines(TLDList *tld, const char *buf, size_t len, int final,
+                    const char **bad, unsigned long *lines) {
+    return ingest_run(tld, buf, len, final, bad, lines, NULL);
+}
+
+size_t ingest_sorted(TLDList *tld, const char *buf, size_t len, int final,
+                     const char **bad, unsigned long *lines, uint32_t *last) {
+    return ingest_run(tld, buf, len, final, bad, lines, last);
+}
+
+// Both of the above, inlined into each so that ingest_lines keeps no order
+static inline size_t ingest_run(TLDList *tld, const char *buf, size_t len, int final,
+                                const char **bad, unsigned long *lines, uint32_t *last) {
+    ScanLine fields[SCANBATCH];
+    TLDHost hosts[SCANBATCH];
+    const char *p = buf, *end = buf + len;
+    size_t i, k, n, used;
+    unsigned long before = *lines;
+    LogLine ll;
+
+    *bad = NULL;
+    while (p < end) {
+        STATS_START(parse);
+        n = scan_lines(p, end - p, fields, SCANBATCH, &used);
+        STATS_STOP(STATS_PARSE, parse);
+        STATS_START(insert);
+        // The date field is at least as long as a date and followed by a space,
+        // so reading the 11 bytes date_parse_packed() needs stays inside the line
+        for (i = k = 0; i < n; i++) {
+            if (fields[i].space - fields[i].start < 10 || !date_parse_packed(p + fields[i].start, &hosts[k].date)) {
+                STATS_ADD(STATS_BAD_DATE, 1);
+                continue;
+            }
+            if (last != NULL) { check_order(last, hosts[k].date); }
+            hosts[k].host = p + fields[i].host;
+            hosts[k].hostlen = fields[i].end - fields[i].host;
+            hosts[k++].tldlen = fields[i].end - fields[i].tld;
+        }
+        (void) tldlist_add_batch(tld, hosts, k);
+        STATS_STOP(STATS_INSERT, insert);
+        *lines += n;
+        p += used;
+        if (n < SCANBATCH && p < end) {
+            // The scanner stopped short, let the line parser have the final say
+            if (!logline_parse(p, end, &ll)) {
+                if (!final && memchr(p, '\n', end - p) == NULL && end - p < LOGLINE_MAX - 1) {
+                    break;      // Just incomplete, the rest is still to come
+                }
+                *bad = p;
+                break;
+            }
+            count_fields(tld, ll.date, ll.datelen, ll.host, ll.hostlen, ll.tldlen, last);
+            (*lines)++;
+            p = ll.next;
+        }
+    }
+    STATS_ADD(STATS_LINES, *lines - before);
+    STATS_ADD(STATS_BYTES, p - buf);
+    return p - buf;
+}
+
+void ingest_line(TLDList *tld, const LogLine *ll) {
+    count_fields(tld, ll->date, ll->datelen, ll->host, ll->hostlen, ll->tldlen, NULL);
+}
+
+int ingest_window(const char *buf, size_t len, uint32_t begin, uint32_t end,
+                  const char **from, const char **to) {
+    const char *p;
+    uint32_t date = 0, last = 0;
+
+    // Packed dates are integers, so the first line after `end' is the first dated end + 1 or later
+    *from = first_dated(buf, buf + len, buf + len, begin);
+    *to = first_dated(*from, buf + len, buf + len, end + 1);
+
+    // Disorder inside the window shows as it is counted, but the search saw
+    // only a few lines outside it: check the dated lines next to it, ...
+    for (p = *from; p > buf && date == 0; ) {
+        p = line_before(p, buf);
+        date = ingest_date(p, buf + len);
+    }
+    if (date >= begin) {
+        return 0;
+    }
+    date = dated_from(*to, buf + len);
+    if (date != 0 && date <= end) {
+        return 0;
+    }
+    // ... and a sample across the whole log, which sorted logs joined in the wrong order fail
+    for (size_t i = 1; i <= PROBES; i++) {
+        p = line_after(buf + len / (PROBES + 1) * i, buf, buf + len);
+        if (p == buf) {
+            break;      // Past the last line start
+        }
+        date = dated_from(p, buf + len);
+        if (date != 0 && date < last) {
+            return 0;
+        }
+        last = (date != 0) ? date : last;
+    }
+    return 1;
+}
+
+uint32_t ingest_date(const char *line, const char *end) {
+    uint32_t packed;
+    // date_parse_packed() reads 11 bytes, which could run into the next line but no further
+    if (end - line < 11 || !date_parse_packed(line, &packed)) {
+        return 0;
+    }
+    return packed;
+}
+
+void ingest_illegal(const char *line, const char *end) {
+    const char *nl = memchr(line, '\n', end - line);
+    size_t len = (nl == NULL) ? (size_t)(end - line) : (size_t)(nl - line) + 1;
+
+    if (len > LOGLINE_MAX - 1) {
+        len = LOGLINE_MAX - 1;
+        STATS_ADD(STATS_TOO_LONG, 1);
+    } else {
+        STATS_ADD(STATS_MALFORMED, 1);
+    }
+    fprintf(stderr, "Illegal input line: %.*s", (int)len, line);
+}
+
+// Once a line turns up dated before the one ahead of it, the order is lost for good
+static inline void check_order(uint32_t *last, uint32_t date) {
+    if (*last != INGEST_UNSORTED) {
+        *last = (date < *last) ? INGEST_UNSORTED : date;
+    }
+}
+
+// The start of the first line in lo..hi dated `key' or later, hi if there is
+// none; `lo' and `hi' are line starts, and a date may be read up to `limit'
+static const char *first_dated(const char *lo, const char *hi, const char *limit, uint32_t key) {
+    while (lo < hi) {
+        // Every line before lo is dated earlier than key and none from hi on is
+        const char *s = line_after(lo + (hi - lo) / 2, lo, hi), *t = s;
+        uint32_t date = 0;
+        while (t < hi && (date = ingest_date(t, limit)) == 0) {
+            t = next_line(t, hi);
+        }
+        if (t < hi && date < key) {
+            lo = next_line(t, hi);
+        } else {
+            hi = s;
+        }
+    }
+    return hi;
+}
+
+// The first line start at or after `p' and before `hi', or `lo' if there is none
+static const char *line_after(const char *p, const char *lo, const char *hi) {
+    const char *nl;
+    if (p == lo) {
+        return lo;
+    }
+    nl = memchr(p - 1, '\n', hi - (p - 1));
+    return (nl == NULL || nl + 1 >= hi) ? lo : nl + 1;
+}
+
+// The start of the line before the one starting at `p', which is after `lo'
+static const char *line_before(const char *p, const char *lo) {
+    for (p--; p > lo && p[-1] != '\n'; p--) {}
+    return p;
+}
+
+// The date of the first dated line from `p' on, 0 if there is none before `hi'
+static uint32_t dated_from(const char *p, const char *hi) {
+    uint32_t date = 0;
+    while (p < hi && (date = ingest_date(p, hi)) == 0) {
+        p = next_line(p, hi);
+    }
+    return date;
+}
+
+static const char *next_line(const char *p, const char *hi) {
+    const char *nl = memchr(p, '\n', hi - p);
+    return (nl == NULL) ? hi : nl + 1;
+}
+
+// As for a scanned batch, but one line at a time
+static void count_fields(TLDList *tld, const char *date, size_t datelen, const char *host, size_t hostlen,
+                         size_t tldlen, uint32_t *last) {
+    uint32_t packed;
+
+    if (datelen >= 10 && date_parse_packed(date, &packed)) {
+        if (last != NULL) { check_order(last, packed); }
+        (void) tldlist_add_host(tld, host, hostlen, tldlen, packed);
+    } else {
+        STATS_ADD(STATS_BAD_DATE, 1);
+    }
+}
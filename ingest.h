@@ -0,0 +1,65 @@
+#ifndef _INGEST_H_INCLUDED_
+#define _INGEST_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tldlist.h"
+#include "logline.h"
+
+/*
+ * ingest_lines counts the log lines at the start of `buf' into `tld' in
+ * place, without copying them or allocating; scan_lines() finds the fields
+ * of a batch of lines at a time, which go to tldlist_add_batch() together,
+ * and a line the scanner stops at is re-checked with logline_parse()
+ * stops at the first illegal line, setting `*bad' to its start; a last line
+ * with no newline is illegal if `final' is set, otherwise it is left for
+ * the caller to complete once more data arrives and `*bad' is NULL
+ * `*lines' is increased by the number of lines counted
+ * returns the number of bytes consumed
+ */
+size_t ingest_lines(TLDList *tld, const char *buf, size_t len, int final,
+                    const char **bad, unsigned long *lines);
+
+/*
+ * ingest_sorted is ingest_lines() for a log that should be in date order,
+ * checking that it is as it goes: `*last' holds the date of the last line
+ * counted (0 before the first), and once a line is dated earlier than the
+ * one before it, it is set to INGEST_UNSORTED and left there
+ */
+#define INGEST_UNSORTED UINT32_MAX
+size_t ingest_sorted(TLDList *tld, const char *buf, size_t len, int final,
+                     const char **bad, unsigned long *lines, uint32_t *last);
+
+/*
+ * ingest_window narrows the date-sorted log in the `len' bytes at `buf' to
+ * the lines dated `begin'..`end' (packed), by binary search, so that only
+ * O(log len) lines outside them are ever looked at: `*from' is set to the
+ * start of the first line dated `begin' or later, and `*to' to the start of
+ * the first one dated after `end' (or the end of the buffer); lines with no
+ * date go with the first dated line after them
+ * returns 1 if the dated lines either side of the window are dated outside
+ * it, and a sample of lines spread over the whole log are in date order, as
+ * in a sorted log, 0 if not; other lines outside the window are never read,
+ * so a log out of order only there still gets a window that misses some
+ */
+int ingest_window(const char *buf, size_t len, uint32_t begin, uint32_t end,
+                  const char **from, const char **to);
+
+/*
+ * ingest_date returns the packed date of the line starting at `line', or 0
+ * if it does not start with one; no more than `end' - `line' bytes are read
+ */
+uint32_t ingest_date(const char *line, const char *end);
+
+/*
+ * ingest_line counts the single parsed line `ll' into `tld'
+ */
+void ingest_line(TLDList *tld, const LogLine *ll);
+
+/*
+ * ingest_illegal reports the illegal line starting at `line' (and not
+ * extending past `end') on stderr, in the same form as the fgets() path
+ */
+void ingest_illegal(const char *line, const char *end);
+
+#endif /* _INGEST_H_INCLUDED_ */
@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <string.h>
+#include "labeltrie.h"
+#include "arena.h"
+#include "mem.h"
+#include "logline.h"
+
+// Macros and Enumerations
+#define TRIE_INITIAL 256        // Must be a power of two
+#define NODE_SLAB 256           // Nodes in the first slab, later slabs double
+#define NAME_POOL 4096          // Bytes in the first label pool block
+#define FNV_PRIME 1099511628211UL
+#define FNV_OFFSET 14695981039346656037UL
+
+// Definitions for each structure
+struct labelslot {
+    unsigned long hash;
+    struct labelnode *node;
+};
+
+struct labelnode {
+    struct labelnode *parent;
+    struct labelnode *child;    // First child seen
+    struct labelnode *last;     // Last child seen, where the next one is linked
+    struct labelnode *sibling;
+    const char *label;          // This level's label alone, in the label pool
+    unsigned long hash;         // Of the whole suffix, so the table needs only one key
+    long count;
+    uint32_t len;
+    uint32_t children;
+};
+
+struct labeltrie {
+    int depth;
+    size_t longest;
+    struct labelnode root;
+    struct labelslot *slots;    // Every non-root node, keyed on (parent, label)
+    unsigned long capacity;
+    unsigned long used;
+    Arena *nodes;
+    Arena *names;
+};
+
+// File Specific Prototypes
+static LabelNode *trie_child(LabelTrie *t, LabelNode *parent, const char *label, size_t len);
+static int trie_grow(LabelTrie *t);
+static int merge_children(LabelTrie *dst, LabelNode *into, LabelNode *from);
+static unsigned long label_hash(unsigned long seed, const char *s, size_t len);
+static int label_equal(const char *s1, const char *s2, size_t len);
+
+LabelTrie *labeltrie_create(int depth) {
+    LabelTrie *t = (LabelTrie *) mem_calloc(1, sizeof(LabelTrie));
+    if (t == NULL) { return NULL; }
+    t->depth = depth;
+    t->root.label = "";
+    t->root.hash = FNV_OFFSET;
+    t->slots = (struct labelslot *) mem_calloc(TRIE_INITIAL, sizeof(struct labelslot));
+    t->capacity = TRIE_INITIAL;
+    t->nodes = arena_create(NODE_SLAB * sizeof(LabelNode));
+    t->names = arena_create(NAME_POOL);
+    if (depth < 1 || t->slots == NULL || t->nodes == NULL || t->names == NULL) {
+        labeltrie_destroy(t);
+        return NULL;
+    }
+    return t;
+}
+
+void labeltrie_destroy(LabelTrie *t) {
+    if (t->nodes != NULL) { arena_destroy(t->nodes); }
+    if (t->names != NULL) { arena_destroy(t->names); }
+    mem_free(t->slots);
+    mem_free(t);
+}
+
+int labeltrie_add(LabelTrie *t, const char *host, size_t len, long count) {
+    LabelNode *node = &t->root;
+    const char *end = host + len;
+
+    // Peel the labels off the right-hand end, one level per label
+    node->count += count;
+    for (int level = 0; level < t->depth; level++) {
+        const char *dot = end;
+        while (dot > host && dot[-1] != '.') { dot--; }
+        node = trie_child(t, node, dot, end - dot);
+        if (node == NULL) { return 0; }
+        node->count += count;
+        if ((size_t)(host + len - dot) > t->longest) { t->longest = host + len - dot; }
+        if (dot == host) { break; }
+        end = dot - 1;
+    }
+    return 1;
+}
+
+int labeltrie_merge(LabelTrie *dst, LabelTrie *src) {
+    dst->root.count += src->root.count;
+    if (src->longest > dst->longest) { dst->longest = src->longest; }
+    return merge_children(dst, &dst->root, &src->root);
+}
+
+// Depth first, so each of `into''s children is complete before the next is started
+static int merge_children(LabelTrie *dst, LabelNode *into, LabelNode *from) {
+    for (LabelNode *c = from->child; c != NULL; c = c->sibling) {
+        LabelNode *node = trie_child(dst, into, c->label, c->len);
+        if (node == NULL) { return 0; }
+        node->count += c->count;
+        if (!merge_children(dst, node, c)) { return 0; }
+    }
+    return 1;
+}
+
+int labeltrie_depth(LabelTrie *t) {
+    return t->depth;
+}
+
+size_t labeltrie_longest(LabelTrie *t) {
+    return t->longest;
+}
+
+LabelNode *labeltrie_root(LabelTrie *t) {
+    return &t->root;
+}
+
+/*
+/
+/ LabelNode Implementation
+/
+*/
+
+LabelNode *labelnode_child(LabelNode *node) {
+    return node->child;
+}
+
+LabelNode *labelnode_sibling(LabelNode *node) {
+    return node->sibling;
+}
+
+long labelnode_children(LabelNode *node) {
+    return node->children;
+}
+
+const char *labelnode_label(LabelNode *node) {
+    return node->label;
+}
+
+long labelnode_count(LabelNode *node) {
+    return node->count;
+}
+
+/*
+/
+/ Hash Table Implementation
+/
+*/
+
+// Finds the child of `parent' labelled `label', creating it with a zero count if new
+static LabelNode *trie_child(LabelTrie *t, LabelNode *parent, const char *label, size_t len) {
+    unsigned long hash = label_hash(parent->hash, label, len);
+    unsigned long mask = t->capacity - 1;
+    unsigned long i = hash & mask;
+
+    while (t->slots[i].node != NULL) {
+        LabelNode *n = t->slots[i].node;
+        if (t->slots[i].hash == hash && n->parent == parent && n->len == len && label_equal(label, n->label, len)) {
+            return n;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // Keep the load factor under a half, as the TLD hash table does
+    if (2 * (t->used + 1) > t->capacity) {
+        if (!trie_grow(t)) { return NULL; }
+        mask = t->capacity - 1;
+        for (i = hash & mask; t->slots[i].node != NULL; i = (i + 1) & mask) {}
+    }
+    LabelNode *node = (LabelNode *) arena_alloc(t->nodes, sizeof(LabelNode), _Alignof(LabelNode));
+    char *copy = arena_strndup(t->names, label, len);
+    if (node == NULL || copy == NULL) { return NULL; }
+    node->parent   = parent;
+    node->child    = NULL;
+    node->last     = NULL;
+    node->sibling  = NULL;
+    node->label    = copy;
+    node->hash     = hash;
+    node->count    = 0;
+    node->len      = len;
+    node->children = 0;
+    if (parent->last == NULL) { parent->child = node; } else { parent->last->sibling = node; }
+    parent->last = node;
+    parent->children++;
+    t->slots[i].hash = hash;
+    t->slots[i].node = node;
+    t->used++;
+    return node;
+}
+
+static int trie_grow(LabelTrie *t) {
+    unsigned long capacity = t->capacity * 2;
+    unsigned long mask = capacity - 1;
+    struct labelslot *slots = (struct labelslot *) mem_calloc(capacity, sizeof(struct labelslot));
+    if (slots == NULL) { return 0; }
+    for (unsigned long j = 0; j < t->capacity; j++) {
+        if (t->slots[j].node != NULL) {
+            unsigned long i = t->slots[j].hash & mask;
+            while (slots[i].node != NULL) { i = (i + 1) & mask; }
+            slots[i] = t->slots[j];
+        }
+    }
+    mem_free(t->slots);
+    t->slots = slots;
+    t->capacity = capacity;
+    return 1;
+}
+
+// FNV-1a of the lower-cased label and a separator, carried on from the parent's
+// hash so that equal labels under different parents land apart
+static unsigned long label_hash(unsigned long seed, const char *s, size_t len) {
+    unsigned long hash = seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= LOGLINE_FOLD(s[i]);
+        hash *= FNV_PRIME;
+    }
+    hash ^= '.';
+    return hash * FNV_PRIME;
+}
+
+static int label_equal(const char *s1, const char *s2, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (LOGLINE_FOLD(s1[i]) != LOGLINE_FOLD(s2[i])) { return 0; }
+    }
+    return 1;
+}
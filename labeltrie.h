@@ -0,0 +1,82 @@
+#ifndef _LABELTRIE_H_INCLUDED_
+#define _LABELTRIE_H_INCLUDED_
+
+#include <stddef.h>
+
+typedef struct labeltrie LabelTrie;
+typedef struct labelnode LabelNode;
+
+/*
+ * labeltrie_create generates a trie for counting hostnames by their
+ * domain suffixes: the labels of each hostname are walked from the right,
+ * so that "www.gla.ac.uk" counts once against "uk", "ac.uk", "gla.ac.uk"
+ * and so on, down to `depth' labels
+ * nodes and labels are carved out of arenas, and children are found
+ * through one hash table for the whole trie, so no label costs an
+ * allocation of its own
+ * returns a pointer to the trie if successful, NULL if not
+ */
+LabelTrie *labeltrie_create(int depth);
+
+/*
+ * labeltrie_destroy returns all storage held by the trie `t' to the heap
+ */
+void labeltrie_destroy(LabelTrie *t);
+
+/*
+ * labeltrie_add counts the `len' bytes of `host' (which need not be
+ * NUL-terminated) `count' times at every level of the trie it reaches;
+ * labels compare without regard to case, and keep the spelling they were
+ * first seen in
+ * returns 1 if successful, 0 if not (memory allocation failure)
+ */
+int labeltrie_add(LabelTrie *t, const char *host, size_t len, long count);
+
+/*
+ * labeltrie_merge adds every count held in `src' to `dst', which must be
+ * at least as deep; children are merged in the order `src' first saw them,
+ * so `dst' grows exactly as it would have on `src''s hostnames
+ * returns 1 if successful, 0 if not (memory allocation failure)
+ */
+int labeltrie_merge(LabelTrie *dst, LabelTrie *src);
+
+/*
+ * labeltrie_depth returns the number of levels the trie counts
+ */
+int labeltrie_depth(LabelTrie *t);
+
+/*
+ * labeltrie_longest returns the length of the longest suffix in the trie,
+ * such as "gla.ac.uk", for sizing a buffer to build names in
+ */
+size_t labeltrie_longest(LabelTrie *t);
+
+/*
+ * labeltrie_root returns the node above the TLDs; its count is the
+ * number of hostnames added
+ */
+LabelNode *labeltrie_root(LabelTrie *t);
+
+/*
+ * labelnode_child returns the first child of `node', and labelnode_sibling
+ * the one after `node', in the order they were first seen; NULL if none
+ */
+LabelNode *labelnode_child(LabelNode *node);
+LabelNode *labelnode_sibling(LabelNode *node);
+
+/*
+ * labelnode_children returns the number of children of `node'
+ */
+long labelnode_children(LabelNode *node);
+
+/*
+ * labelnode_label returns the single label of `node', "ac" for "ac.uk"
+ */
+const char *labelnode_label(LabelNode *node);
+
+/*
+ * labelnode_count returns the number of hostnames counted under `node'
+ */
+long labelnode_count(LabelNode *node);
+
+#endif /* _LABELTRIE_H_INCLUDED_ */
@@ -0,0 +1,35 @@
+#include <string.h>
+#include "logline.h"
+
+int logline_parse(const char *line, const char *end, LogLine *ll) {
+    const char *p = line, *limit, *dot;
+
+    // Nothing past the longest line fgets() would have accepted can matter
+    limit = (end - line > LOGLINE_MAX - 1) ? line + LOGLINE_MAX - 1 : end;
+
+    // Date field runs up to the first space, the hostname starts after the spaces
+    while (p < limit && *p != ' ' && *p != '\n')
+        p++;
+    if (p == limit || *p == '\n')
+        return 0;
+    ll->date = line;
+    ll->datelen = p - line;
+    while (p < limit && *p == ' ')
+        p++;
+    ll->host = p;
+
+    // One pass over the hostname finds both the newline and the last dot
+    dot = NULL;
+    while (p < limit && *p != '\n') {
+        if (*p == '.')
+            dot = p;
+        p++;
+    }
+    if (p == limit)
+        return 0;
+    ll->hostlen = p - ll->host;
+    ll->tld = (dot == NULL) ? ll->host : dot + 1;
+    ll->tldlen = p - ll->tld;
+    ll->next = p + 1;
+    return 1;
+}
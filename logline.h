@@ -0,0 +1,44 @@
+#ifndef _LOGLINE_H_INCLUDED_
+#define _LOGLINE_H_INCLUDED_
+
+#include <stddef.h>
+
+/*
+ * longest line accepted, including the newline; matches the buffer the
+ * fgets() input path reads into
+ */
+#define LOGLINE_MAX 1024
+
+/*
+ * LOGLINE_FOLD is the byte `c' of a hostname as an unsigned char, with an
+ * ASCII capital lowered; tolower() without the locale, for hashing names
+ * and comparing them without regard to case; `c' is evaluated more than
+ * once, so it must have no side effects
+ */
+#define LOGLINE_FOLD(c) (((unsigned) ((unsigned char) (c) - 'A') < 26u) ? (unsigned char) (c) + 32 : (unsigned char) (c))
+
+typedef struct logline LogLine;
+
+/*
+ * the fields of one "dd/mm/yyyy hostname" log line; every pointer borrows
+ * from the caller's buffer and none of the fields is NUL-terminated
+ */
+struct logline {
+    const char *date;           /* start of the date field */
+    size_t datelen;
+    const char *host;           /* hostname, after any run of spaces */
+    size_t hostlen;
+    const char *tld;            /* the hostname after its last '.' */
+    size_t tldlen;
+    const char *next;           /* first byte after this line's newline */
+};
+
+/*
+ * logline_parse splits the line starting at `line' (and not extending past
+ * `end') into its fields in a single scan, without copying or allocating
+ * returns 1 if the line is legal, 0 if not (no space, no terminating
+ * newline, or longer than LOGLINE_MAX - 2 bytes before the newline)
+ */
+int logline_parse(const char *line, const char *end, LogLine *ll);
+
+#endif /* _LOGLINE_H_INCLUDED_ */
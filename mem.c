@@ -0,0 +1,38 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+// Relaxed atomics, the count is only ever read once the threads are done
+static unsigned long allocations = 0;
+
+void *mem_malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+void *mem_calloc(size_t nmemb, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return calloc(nmemb, size);
+}
+
+void *mem_realloc(void *p, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return realloc(p, size);
+}
+
+char *mem_strndup(const char *s, size_t n) {
+    char *p = (char *) mem_malloc(n + 1);
+    if (p != NULL) {
+        memcpy(p, s, n);
+        p[n] = '\0';
+    }
+    return p;
+}
+
+void mem_free(void *p) {
+    free(p);
+}
+
+unsigned long mem_allocations(void) {
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,27 @@
+#ifndef _MEM_H_INCLUDED_
+#define _MEM_H_INCLUDED_
+
+#include <stddef.h>
+
+/*
+ * mem_malloc, mem_calloc, mem_realloc and mem_strndup behave as malloc(),
+ * calloc(), realloc() and strndup() but are counted, so that callers can
+ * check how many times the allocator was entered; safe to call from
+ * several threads
+ */
+void *mem_malloc(size_t size);
+void *mem_calloc(size_t nmemb, size_t size);
+void *mem_realloc(void *p, size_t size);
+char *mem_strndup(const char *s, size_t n);
+
+/*
+ * mem_free returns storage obtained from the functions above to the system
+ */
+void mem_free(void *p);
+
+/*
+ * mem_allocations returns the number of allocations made since startup
+ */
+unsigned long mem_allocations(void);
+
+#endif /* _MEM_H_INCLUDED_ */
@@ -0,0 +1,198 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "readahead.h"
+#include "ingest.h"
+#include "logline.h"
+#include "mem.h"
+#include "stats.h"
+
+// Macros and Enumerations
+#define READ_SLOTS 4            // Buffers in the ring, a power of two
+#define READ_BLOCK (1 << 20)    // Bytes read into each buffer at most
+#define READ_ALIGN 4096         // Buffers start on a page
+#define HEADROOM ((LOGLINE_MAX + READ_ALIGN - 1) / READ_ALIGN * READ_ALIGN)
+
+// Definitions for each structure
+struct buffer {
+    char *block;                // The allocation, see ring_create
+    char *data;                 // At least HEADROOM bytes into it, on a page
+    size_t len;                 // Zero for the last buffer of the input
+};
+
+struct reader {
+    int fd;
+    struct buffer ring[READ_SLOTS];
+    unsigned long head;         // Buffers the parser has finished with, only it writes this
+    unsigned long tail;         // Buffers the reader has filled, only it writes this
+    int parser_waiting;         // Set by a side about to sleep, see ring_park
+    int reader_waiting;
+    sem_t filled;               // Posted to wake a sleeping parser
+    sem_t freed;                // Posted to wake a sleeping reader
+    int eof;                    // read() has returned 0, so ask no more of a terminal
+    int error;                  // read() failed
+};
+
+// File Specific Prototypes
+static void *reader_thread(void *arg);
+static size_t reader_fill(struct reader *r, char *out, size_t cap);
+static void ring_park(int *waiting, sem_t *sem, unsigned long *index, unsigned long seen);
+static void ring_wake(int *waiting, sem_t *sem);
+static struct reader *ring_create(int fd);
+static void ring_destroy(struct reader *r);
+
+int readahead_stream(int fd, const char *head, size_t len, TLDList *tld, unsigned long *lines) {
+    struct reader *r = ring_create(fd);
+    pthread_t tid;
+    unsigned long taken = 0;
+    size_t have = len;
+    const char *bad = NULL;
+    int status;
+
+    if (r == NULL) { return -1; }
+    memcpy(r->ring[0].data - have, head, have);
+    if (pthread_create(&tid, NULL, reader_thread, r) != 0) {
+        ring_destroy(r);
+        return -1;
+    }
+
+    for (;;) {
+        while (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == taken) {
+            ring_park(&r->parser_waiting, &r->filled, &r->tail, taken);
+        }
+        struct buffer *b = &r->ring[taken % READ_SLOTS];
+
+        // The incomplete line from the last buffer is already in the room in front of this one
+        char *start = b->data - have;
+        size_t total = have + b->len;
+        size_t used = ingest_lines(tld, start, total, b->len == 0, &bad, lines);
+        if (bad != NULL) {
+            ingest_illegal(bad, start + total);
+            break;
+        }
+        if (b->len == 0) {
+            break;
+        }
+        // So the line this one ends with moves in front of the next; the reader
+        // only ever writes past a buffer's data pointer, so it can go there now
+        have = total - used;
+        memcpy(r->ring[(taken + 1) % READ_SLOTS].data - have, start + used, have);
+        __atomic_store_n(&r->head, ++taken, __ATOMIC_SEQ_CST);
+        ring_wake(&r->reader_waiting, &r->freed);
+    }
+
+    // An illegal line stops the count, and the reader could be blocked on a
+    // pipe that never ends, so it is cancelled rather than drained
+    if (bad != NULL) {
+        pthread_cancel(tid);
+    }
+    pthread_join(tid, NULL);
+    status = (bad == NULL && r->error) ? -1 : 0;
+    ring_destroy(r);
+    return status;
+}
+
+// Fill free buffers until the input ends, then hand over an empty one to say so
+static void *reader_thread(void *arg) {
+    struct reader *r = arg;
+    unsigned long filled = 0;
+    size_t len;
+
+    do {
+        while (filled - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == READ_SLOTS) {
+            ring_park(&r->reader_waiting, &r->freed, &r->head, filled - READ_SLOTS);
+        }
+        struct buffer *b = &r->ring[filled % READ_SLOTS];
+
+        STATS_START(reading);
+        len = b->len = reader_fill(r, b->data, READ_BLOCK);
+        STATS_STOP(STATS_READ, reading);
+
+        __atomic_store_n(&r->tail, ++filled, __ATOMIC_SEQ_CST);
+        ring_wake(&r->parser_waiting, &r->filled);
+    } while (len > 0);
+    stats_flush();
+    return NULL;
+}
+
+// Read up to `cap' bytes into `out': a pipe gives what it holds at each
+// read(), so keep reading while the parser is busy, and hand over what
+// there is as soon as it's waiting; returns 0 only at the end of the input
+static size_t reader_fill(struct reader *r, char *out, size_t cap) {
+    size_t len = 0;
+    while (len < cap && !r->eof) {
+        ssize_t got = read(r->fd, out + len, cap - len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            r->error = (got < 0);
+            r->eof = 1;
+            break;
+        }
+        len += got;
+        if (__atomic_load_n(&r->parser_waiting, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    return len;
+}
+
+/*
+/
+/ Ring Implementation
+/
+*/
+
+// The buffers are handed over by the two counters alone; a side only sleeps
+// when the ring is empty (or full), after flagging that it's about to and
+// checking the other side's counter `index' is still `seen', and the other
+// side posts the semaphore only if it finds the flag set after moving its
+// counter, so no wakeup is lost and a busy pipeline makes no system calls
+static void ring_park(int *waiting, sem_t *sem, unsigned long *index, unsigned long seen) {
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(index, __ATOMIC_SEQ_CST) != seen) {
+        // Moved meanwhile; a post that follows only makes a later sleep return early
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+    while (sem_wait(sem) < 0 && errno == EINTR) {
+        ;
+    }
+}
+
+static void ring_wake(int *waiting, sem_t *sem) {
+    if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST)) {
+        sem_post(sem);
+    }
+}
+
+static struct reader *ring_create(int fd) {
+    struct reader *r = (struct reader *) mem_calloc(1, sizeof(struct reader));
+    if (r == NULL) { return NULL; }
+    r->fd = fd;
+    sem_init(&r->filled, 0, 0);
+    sem_init(&r->freed, 0, 0);
+    for (int i = 0; i < READ_SLOTS; i++) {
+        struct buffer *b = &r->ring[i];
+        b->block = (char *) mem_malloc(HEADROOM + READ_BLOCK + READ_ALIGN);
+        if (b->block == NULL) {
+            ring_destroy(r);
+            return NULL;
+        }
+        b->data = (char *) (((uintptr_t) b->block + HEADROOM + READ_ALIGN - 1) & ~(uintptr_t) (READ_ALIGN - 1));
+    }
+    return r;
+}
+
+static void ring_destroy(struct reader *r) {
+    for (int i = 0; i < READ_SLOTS; i++) {
+        if (r->ring[i].block != NULL) { mem_free(r->ring[i].block); }
+    }
+    sem_destroy(&r->filled);
+    sem_destroy(&r->freed);
+    mem_free(r);
+}
@@ -0,0 +1,21 @@
+#ifndef _READAHEAD_H_INCLUDED_
+#define _READAHEAD_H_INCLUDED_
+
+#include <stddef.h>
+#include "tldlist.h"
+
+/*
+ * readahead_stream counts the log lines read from the descriptor `fd', a
+ * pipe, terminal or anything else that cannot be mapped; a thread of its
+ * own read()s the input into a small ring of large page-aligned buffers,
+ * handed over without a lock, so that waiting on the input overlaps
+ * counting it; the `len' bytes at `head', fewer than LOGLINE_MAX of them,
+ * were read from `fd' already and are counted first
+ * lines are treated as in a mapped file, stopping at the first illegal one
+ * `*lines' is increased by the number of lines counted
+ * returns 0 if successful, -1 if reading `fd' failed (the lines read before
+ * the failure are still counted) or the reader could not be set up
+ */
+int readahead_stream(int fd, const char *head, size_t len, TLDList *tld, unsigned long *lines);
+
+#endif /* _READAHEAD_H_INCLUDED_ */
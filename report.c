@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "report.h"
+#include "mem.h"
+
+// Macros and Enumerations
+#define OUTBUF (1 << 16)
+#define EXACT_TOTAL (1L << 31)  // Below this, integer rounding agrees with "%6.2f"
+#define PERCENT_WIDTH 6
+#define INDENT "  "             // Per level of a --depth report
+#define DISTINCT " \u2248"        // Before the estimate of distinct hostnames, as UTF-8
+
+// Definitions for each structure
+struct writer {
+    FILE *fp;
+    size_t len;
+    int error;
+    char buf[OUTBUF];
+};
+
+// A child in a --depth report, sortable as the TLDEntry it starts with
+struct level_entry {
+    TLDEntry entry;
+    LabelNode *node;
+};
+
+// File Specific Prototypes
+static int report_run(TLDList *tld, int ranged, uint32_t begin, uint32_t end,
+                      enum report_order order, long top, FILE *fp);
+static int report_entries(TLDEntry *entries, long n, long total, int sorted,
+                          enum report_order order, long top, FILE *fp);
+static int store_run(TLDStore *store, int ranged, uint32_t begin, uint32_t end,
+                     enum report_order order, long top, FILE *fp);
+static TLDEntry *range_entries(TLDList *tld, uint32_t begin, uint32_t end, long *n);
+static TLDEntry *hosts_top(HostCursor *c, long top, long *n);
+static void writer_flush(struct writer *w);
+static void writer_put(struct writer *w, const char *s, size_t n);
+static int depth_level(struct writer *w, LabelNode *parent, char *suffix, int level,
+                       enum report_order order, long top);
+static void writer_line(struct writer *w, TLDEntry *e, long total, int level);
+static size_t format_percent(char *out, long count, long total);
+static size_t format_long(char *out, long n);
+static int rank_less(TLDEntry *a, TLDEntry *b);
+static void heap_sift_down(TLDEntry *heap, long n, long i);
+static void select_top(TLDEntry *entries, long n, long top);
+
+int report_print(TLDList *tld, enum report_order order, long top, FILE *fp) {
+    return report_run(tld, 0, 0, 0, order, top, fp);
+}
+
+int report_print_range(TLDList *tld, uint32_t begin, uint32_t end,
+                       enum report_order order, long top, FILE *fp) {
+    return report_run(tld, 1, begin, end, order, top, fp);
+}
+
+static int report_run(TLDList *tld, int ranged, uint32_t begin, uint32_t end,
+                      enum report_order order, long top, FILE *fp) {
+    TLDSnapshot *snap = NULL;
+    TLDEntry *entries = NULL;
+    long n = 0, total = 0;
+    int status = -1, sorted = 0;
+
+    // The whole list comes as a snapshot, already sorted unless a `top' has to be
+    // picked by count first; a range leaves out the TLDs it never saw
+    if (ranged) {
+        total = tldlist_count_range(tld, begin, end);
+        entries = (total < 0) ? NULL : range_entries(tld, begin, end, &n);
+        if (entries == NULL) { goto done; }
+    } else {
+        enum tldlist_order want = TLDLIST_UNSORTED;
+        sorted = (top <= 0);
+        if (sorted && order == REPORT_BY_COUNT) { want = TLDLIST_BY_COUNT; }
+        if (sorted && order == REPORT_BY_NAME) { want = TLDLIST_BY_NAME; }
+        snap = tldlist_snapshot(tld, want);
+        if (snap == NULL) { goto done; }
+        entries = tldsnapshot_entries(snap);
+        n = tldsnapshot_size(snap);
+        total = tldsnapshot_count(snap);
+    }
+    status = report_entries(entries, n, total, sorted, order, top, fp);
+
+done:
+    if (snap != NULL) { tldsnapshot_destroy(snap); } else if (entries != NULL) { mem_free(entries); }
+    return status;
+}
+
+// Writes the `n' entries, percentages of `total', keeping only the `top'
+// highest counts and putting them in `order' unless they are `sorted' already
+static int report_entries(TLDEntry *entries, long n, long total, int sorted,
+                          enum report_order order, long top, FILE *fp) {
+    struct writer *w = (struct writer *) mem_malloc(sizeof(struct writer));
+    int status;
+
+    if (w == NULL) { return -1; }
+    w->fp = fp;
+    w->len = 0;
+    w->error = 0;
+    if (top > 0 && top < n) {
+        select_top(entries, n, top);
+        n = top;
+    }
+    if (!sorted && (order != REPORT_UNSORTED || top > 0)) {
+        qsort(entries, n, sizeof(TLDEntry), (order == REPORT_BY_NAME) ? tldentry_by_name : tldentry_by_count);
+    }
+    for (long i = 0; i < n; i++) {
+        writer_line(w, &entries[i], total, 0);
+    }
+    writer_flush(w);
+    status = w->error ? -1 : 0;
+    mem_free(w);
+    return status;
+}
+
+int report_print_store(TLDStore *store, enum report_order order, long top, FILE *fp) {
+    return store_run(store, 0, 0, 0, order, top, fp);
+}
+
+int report_print_store_range(TLDStore *store, uint32_t begin, uint32_t end,
+                             enum report_order order, long top, FILE *fp) {
+    return store_run(store, 1, begin, end, order, top, fp);
+}
+
+// The entries point into the mapping, so nothing but the array is copied;
+// the total is summed from them rather than trusted to the header, as no
+// checksum has vouched for the counts, and a TLD with none is left out
+static int store_run(TLDStore *store, int ranged, uint32_t begin, uint32_t end,
+                     enum report_order order, long top, FILE *fp) {
+    long size = tldstore_size(store), n = 0, total = 0;
+    TLDEntry *entries;
+    int status;
+
+    if (ranged && tldstore_count_range(store, begin, end) < 0) { return -1; }
+    entries = (TLDEntry *) mem_malloc((size > 0 ? size : 1) * sizeof(TLDEntry));
+    if (entries == NULL) { return -1; }
+    for (long i = 0; i < size; i++) {
+        long count = ranged ? tldstore_key_count_range(store, i, begin, end) : tldstore_key_count(store, i);
+        if (count > 0) {
+            entries[n].name = tldstore_name(store, i);
+            entries[n].count = count;
+            entries[n++].distinct = ranged ? -1 : tldstore_key_distinct(store, i);
+            total += count;
+        }
+    }
+    status = report_entries(entries, n, total, 0, order, top, fp);
+    mem_free(entries);
+    return status;
+}
+
+// The counts of every TLD seen in begin..end, in the list's iteration order
+static TLDEntry *range_entries(TLDList *tld, uint32_t begin, uint32_t end, long *n) {
+    TLDIterator *it = tldlist_iter_create(tld);
+    TLDEntry *entries = (TLDEntry *) mem_malloc((tldlist_size(tld) > 0 ? tldlist_size(tld) : 1) * sizeof(TLDEntry));
+    TLDNode *node;
+
+    if (it == NULL || entries == NULL) {
+        if (it != NULL) { tldlist_iter_destroy(it); }
+        if (entries != NULL) { mem_free(entries); }
+        return NULL;
+    }
+    *n = 0;
+    while ((node = tldlist_iter_next(it)) != NULL) {
+        long count = tldnode_count_range(tld, node, begin, end);
+        if (count < 0) {
+            tldlist_iter_destroy(it);
+            mem_free(entries);
+            return NULL;
+        }
+        if (count > 0) {
+            entries[*n].name = tldnode_tldname(node);
+            entries[*n].distinct = -1;
+            entries[(*n)++].count = count;
+        }
+    }
+    tldlist_iter_destroy(it);
+    return entries;
+}
+
+int report_print_depth(TLDList *tld, enum report_order order, long top, FILE *fp) {
+    LabelTrie *trie = tldlist_trie(tld);
+    struct writer *w = NULL;
+    char *names = NULL;
+    int status = -1;
+
+    if (trie == NULL) { return -1; }
+    w = (struct writer *) mem_malloc(sizeof(struct writer));
+    names = (char *) mem_malloc(labeltrie_longest(trie) + 1);
+    if (w == NULL || names == NULL) { goto done; }
+    w->fp = fp;
+    w->len = 0;
+    w->error = 0;
+
+    // Suffixes are built right to left, from the end of `names' back
+    names[labeltrie_longest(trie)] = '\0';
+    if (depth_level(w, labeltrie_root(trie), names + labeltrie_longest(trie), 0, order, top) == 0) {
+        writer_flush(w);
+        status = w->error ? -1 : 0;
+    }
+
+done:
+    if (names != NULL) { mem_free(names); }
+    if (w != NULL) { mem_free(w); }
+    return status;
+}
+
+// Prints the children of `parent', whose full name starts at `suffix', each
+// followed by its own children; siblings are ranked on their labels alone,
+// which orders them exactly as their full names would
+static int depth_level(struct writer *w, LabelNode *parent, char *suffix, int level,
+                       enum report_order order, long top) {
+    long n = labelnode_children(parent), i = 0;
+    struct level_entry *entries;
+    LabelNode *c;
+    int status = 0;
+
+    if (n == 0) { return 0; }
+    entries = (struct level_entry *) mem_malloc(n * sizeof(struct level_entry));
+    if (entries == NULL) { return -1; }
+    for (c = labelnode_child(parent); c != NULL; c = labelnode_sibling(c)) {
+        entries[i].entry.name = labelnode_label(c);
+        entries[i].entry.count = labelnode_count(c);
+        entries[i++].node = c;
+    }
+    if (top > 0 && top < n) {
+        qsort(entries, n, sizeof(struct level_entry), tldentry_by_count);
+        memmove(entries, entries + n - top, top * sizeof(struct level_entry));
+        n = top;
+    }
+    if (order == REPORT_BY_NAME || (order == REPORT_BY_COUNT && top <= 0)) {
+        qsort(entries, n, sizeof(struct level_entry), (order == REPORT_BY_NAME) ? tldentry_by_name : tldentry_by_count);
+    }
+    for (i = 0; i < n && status == 0; i++) {
+        size_t len = strlen(entries[i].entry.name);
+        char *name = suffix - len - (*suffix != '\0');
+        memcpy(name, entries[i].entry.name, len);
+        if (*suffix != '\0') { name[len] = '.'; }
+        TLDEntry line = { name, entries[i].entry.count, -1 };
+        writer_line(w, &line, labelnode_count(parent), level);
+        status = depth_level(w, entries[i].node, name, level + 1, order, top);
+    }
+    mem_free(entries);
+    return status;
+}
+
+int report_print_hosts(TLDList *tld, enum report_order order, long top, FILE *fp) {
+    HostTable *hosts = tldlist_hosts(tld);
+    struct writer *w = NULL;
+    HostCursor *c = NULL;
+    TLDEntry *kept = NULL, e = { NULL, 0, -1 };
+    long n = 0, total = tldlist_count(tld);
+    int status = -1, got;
+
+    if (hosts == NULL) { return -1; }
+    w = (struct writer *) mem_malloc(sizeof(struct writer));
+    // Whole reports come straight off the cursor; a `top' is kept from the name order
+    c = hosttable_cursor(hosts, order == REPORT_BY_COUNT && top <= 0);
+    if (w == NULL || c == NULL) { goto done; }
+    w->fp = fp;
+    w->len = 0;
+    w->error = 0;
+
+    if (top <= 0) {
+        while ((got = hostcursor_next(c, &e.name, &e.count)) == 1) {
+            writer_line(w, &e, total, 0);
+        }
+    } else {
+        kept = hosts_top(c, top, &n);
+        got = (kept == NULL) ? -1 : 0;
+        if (kept != NULL) {
+            qsort(kept, n, sizeof(TLDEntry), (order == REPORT_BY_NAME) ? tldentry_by_name : tldentry_by_count);
+            for (long i = 0; i < n; i++) { writer_line(w, &kept[i], total, 0); }
+        }
+    }
+    if (got == 0) {
+        writer_flush(w);
+        status = w->error ? -1 : 0;
+    }
+
+done:
+    if (kept != NULL) {
+        for (long i = 0; i < n; i++) { mem_free((char *) kept[i].name); }
+        mem_free(kept);
+    }
+    if (c != NULL) { hostcursor_destroy(c); }
+    if (w != NULL) { mem_free(w); }
+    return status;
+}
+
+// The `top' highest counted hostnames off the cursor, as select_top picks
+// them but without holding the rest, with copies of their names
+static TLDEntry *hosts_top(HostCursor *c, long top, long *n) {
+    TLDEntry *kept = (TLDEntry *) mem_malloc(top * sizeof(TLDEntry)), e = { NULL, 0, -1 };
+    int got;
+
+    *n = 0;
+    if (kept == NULL) { return NULL; }
+    while ((got = hostcursor_next(c, &e.name, &e.count)) == 1) {
+        if (*n == top && !rank_less(&kept[0], &e)) {
+            continue;
+        }
+        char *name = mem_strndup(e.name, strlen(e.name));
+        if (name == NULL) {
+            got = -1;
+            break;
+        }
+        if (*n < top) {
+            kept[(*n)++] = (TLDEntry) { name, e.count, -1 };
+            if (*n == top) {
+                for (long i = top / 2 - 1; i >= 0; i--) { heap_sift_down(kept, top, i); }
+            }
+        } else {
+            mem_free((char *) kept[0].name);
+            kept[0] = (TLDEntry) { name, e.count, -1 };
+            heap_sift_down(kept, top, 0);
+        }
+    }
+    if (got < 0) {
+        for (long i = 0; i < *n; i++) { mem_free((char *) kept[i].name); }
+        mem_free(kept);
+        return NULL;
+    }
+    return kept;
+}
+
+/*
+/
+/ Buffered Writer
+/
+*/
+
+static void writer_flush(struct writer *w) {
+    if (w->len > 0 && fwrite(w->buf, 1, w->len, w->fp) != w->len) {
+        w->error = 1;
+    }
+    w->len = 0;
+    if (fflush(w->fp) != 0) {
+        w->error = 1;
+    }
+}
+
+static void writer_put(struct writer *w, const char *s, size_t n) {
+    if (w->len + n > OUTBUF) {
+        writer_flush(w);
+        if (n > OUTBUF) {
+            if (fwrite(s, 1, n, w->fp) != n) { w->error = 1; }
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void writer_line(struct writer *w, TLDEntry *e, long total, int level) {
+    // Same layout as printf("%6.2f %s %ld\n", ...), the name indented by `level'
+    char number[32];
+    size_t n = format_percent(number, e->count, total);
+    number[n++] = ' ';
+    writer_put(w, number, n);
+    while (level-- > 0) { writer_put(w, INDENT, sizeof(INDENT) - 1); }
+    writer_put(w, e->name, strlen(e->name));
+    number[0] = ' ';
+    n = 1 + format_long(number + 1, e->count);
+    if (e->distinct >= 0) {
+        memcpy(number + n, DISTINCT, sizeof(DISTINCT) - 1);
+        n += sizeof(DISTINCT) - 1;
+        n += format_long(number + n, e->distinct);
+    }
+    number[n++] = '\n';
+    writer_put(w, number, n);
+}
+
+/*
+/
+/ Number Formatting
+/
+*/
+
+// Writes 100*count/total as "%6.2f" would into `out', returning its length
+static size_t format_percent(char *out, long count, long total) {
+    // Exactly half way between two hundredths, printf rounds the nearest double
+    // to even, and above EXACT_TOTAL the double's error could cross a boundary,
+    // so in both cases leave it to printf
+    if (total <= 0 || total >= EXACT_TOTAL || count < 0) {
+        return snprintf(out, 32, "%6.2f", 100.0 * (double)count / (double)total);
+    }
+    long hundredths = count * 10000 / total;
+    long remainder = count * 10000 % total;
+    if (2 * remainder == total) {
+        return snprintf(out, 32, "%6.2f", 100.0 * (double)count / (double)total);
+    }
+    if (2 * remainder > total) { hundredths++; }
+
+    // Build the digits backwards, then right-justify them in the field
+    char digits[24];
+    int len = 0;
+    digits[len++] = '0' + hundredths % 10;
+    digits[len++] = '0' + hundredths / 10 % 10;
+    digits[len++] = '.';
+    long whole = hundredths / 100;
+    do {
+        digits[len++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+    size_t n = 0;
+    for (int pad = PERCENT_WIDTH - len; pad > 0; pad--) { out[n++] = ' '; }
+    while (len > 0) { out[n++] = digits[--len]; }
+    return n;
+}
+
+static size_t format_long(char *out, long value) {
+    char digits[24];
+    int len = 0;
+    unsigned long v = (value < 0) ? -(unsigned long)value : (unsigned long)value;
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    size_t n = 0;
+    if (value < 0) { out[n++] = '-'; }
+    while (len > 0) { out[n++] = digits[--len]; }
+    return n;
+}
+
+/*
+/
+/ Ordering
+/
+*/
+
+// True if `a' ranks below `b' in the by-count order
+static int rank_less(TLDEntry *a, TLDEntry *b) {
+    return tldentry_by_count(a, b) < 0;
+}
+
+static void heap_sift_down(TLDEntry *heap, long n, long i) {
+    for (;;) {
+        long least = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && rank_less(&heap[l], &heap[least])) { least = l; }
+        if (r < n && rank_less(&heap[r], &heap[least])) { least = r; }
+        if (least == i) { return; }
+        TLDEntry t = heap[i];
+        heap[i] = heap[least];
+        heap[least] = t;
+        i = least;
+    }
+}
+
+// Gathers the `top' highest ranked entries at the front: a min-heap whose
+// root is the weakest one kept, each later entry either beats it or not
+static void select_top(TLDEntry *entries, long n, long top) {
+    for (long i = top / 2 - 1; i >= 0; i--) { heap_sift_down(entries, top, i); }
+    for (long i = top; i < n; i++) {
+        if (rank_less(&entries[0], &entries[i])) {
+            entries[0] = entries[i];
+            heap_sift_down(entries, top, 0);
+        }
+    }
+}
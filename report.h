@@ -0,0 +1,74 @@
+#ifndef _REPORT_H_INCLUDED_
+#define _REPORT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tldlist.h"
+#include "tldstore.h"
+
+/*
+ * the orders a report can be printed in: as the list's iterator yields the
+ * TLDs, by ascending count (ties by name, as `sort -n' would order the
+ * lines), or by TLD name
+ */
+enum report_order { REPORT_UNSORTED, REPORT_BY_COUNT, REPORT_BY_NAME };
+
+/*
+ * report_print writes a "percentage tld count" line for every TLD in `tld'
+ * to `fp' in `order', with the percentage formatted exactly as printf's
+ * "%6.2f" would; if the list keeps sketches, a fourth column gives the
+ * estimated number of distinct hostnames after a U+2248 ALMOST EQUAL TO
+ * sign, in UTF-8; all output goes through one buffer
+ * if `top' > 0 only the `top' TLDs with the highest counts are printed, in
+ * `order' (REPORT_UNSORTED is taken as REPORT_BY_COUNT)
+ * returns 0 if successful, -1 if not (memory allocation or write failure)
+ */
+int report_print(TLDList *tld, enum report_order order, long top, FILE *fp);
+
+/*
+ * report_print_range is report_print() restricted to the entries dated
+ * `begin'..`end' (packed, see date_pack) of a list created by
+ * tldlist_create_bucketed(); percentages are of the range's total and TLDs
+ * with no entries in the range are left out
+ * returns 0 if successful, -1 if not (or if `tld' is not bucketed)
+ */
+int report_print_range(TLDList *tld, uint32_t begin, uint32_t end,
+                       enum report_order order, long top, FILE *fp);
+
+/*
+ * report_print_store is report_print() for the snapshot `store', answered
+ * straight from its mapping; an unsorted report comes out in name order, as
+ * the snapshot holds the TLDs
+ * returns 0 if successful, -1 if not
+ */
+int report_print_store(TLDStore *store, enum report_order order, long top, FILE *fp);
+
+/*
+ * report_print_store_range is report_print_range() for the snapshot `store'
+ * returns 0 if successful, -1 if not (or if `store' has no day buckets)
+ */
+int report_print_store_range(TLDStore *store, uint32_t begin, uint32_t end,
+                             enum report_order order, long top, FILE *fp);
+
+/*
+ * report_print_depth writes the domain suffixes counted by the LabelTrie of
+ * `tld' (see tldlist_set_depth) as a tree: each TLD is followed by its
+ * second-level suffixes, indented two spaces a level, and so on down; a
+ * TLD's percentage is of all entries, a deeper suffix's of its parent's
+ * count; siblings are printed in `order', and `top' limits each set of
+ * siblings as report_print() limits the TLDs
+ * returns 0 if successful, -1 if not (or if `tld' has no LabelTrie)
+ */
+int report_print_depth(TLDList *tld, enum report_order order, long top, FILE *fp);
+
+/*
+ * report_print_hosts is report_print() for the full hostnames counted by
+ * the HostTable of `tld' (see tldlist_set_hosts), percentages of all
+ * entries; an unsorted report comes out in name order, as the table is read
+ * back, and a `top' is picked as it streams past, so that neither needs
+ * every hostname in memory at once
+ * returns 0 if successful, -1 if not (or if `tld' has no HostTable)
+ */
+int report_print_hosts(TLDList *tld, enum report_order order, long top, FILE *fp);
+
+#endif /* _REPORT_H_INCLUDED_ */
@@ -0,0 +1,155 @@
+#include <string.h>
+#include "scan.h"
+#include "logline.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Macros and Enumerations
+#define BLOCK 64                    // Bytes classified per step, one bit each
+#define MAX_SCAN 0xFFFFFFF0UL       // Keep every offset within 32 bits
+enum state { IN_DATE, IN_SPACES, IN_HOST };
+
+// One classifier per instruction set: newline, space and dot bitmasks for 64 bytes
+typedef void (*classify_fn)(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot);
+
+// File Specific Prototypes
+static void classify_scalar(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot);
+#ifdef SCAN_X86
+static void classify_sse2(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot);
+static void classify_avx2(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot);
+#endif
+
+static classify_fn classify = NULL;
+
+size_t scan_lines(const char *buf, size_t len, ScanLine *out, size_t max, size_t *used) {
+    classify_fn fn = __atomic_load_n(&classify, __ATOMIC_ACQUIRE);
+    size_t n = 0, start = 0, space = 0, host = 0, tld = 0;
+    enum state state = IN_DATE;
+
+    if (fn == NULL) {
+        scan_select(SCAN_AUTO);
+        fn = __atomic_load_n(&classify, __ATOMIC_ACQUIRE);
+    }
+    if (len > MAX_SCAN) { len = MAX_SCAN; }
+
+    for (size_t base = 0; base < len && n < max; base += BLOCK) {
+        uint64_t nl, sp, dot;
+        if (len - base >= BLOCK) {
+            fn(buf + base, &nl, &sp, &dot);
+        } else {
+            // Short tail, classify a zero-padded copy and drop the padding's bits
+            char tail[BLOCK] = {0};
+            uint64_t valid = (1ULL << (len - base)) - 1;
+            memcpy(tail, buf + base, len - base);
+            fn(tail, &nl, &sp, &dot);
+            nl &= valid; sp &= valid; dot &= valid;
+        }
+
+        // Visit only the delimiters, in order, rather than every byte
+        uint64_t events = nl | sp | dot;
+        while (events != 0) {
+            uint64_t bit = events & -events;
+            size_t pos = base + __builtin_ctzll(events);
+            events ^= bit;
+
+            if (state == IN_DATE) {
+                if (sp & bit) {
+                    space = pos;
+                    host = pos + 1;
+                    state = IN_SPACES;
+                } else if (nl & bit) {
+                    goto stop;          // No space on the line
+                }
+                continue;
+            }
+            if (state == IN_SPACES) {
+                if ((sp & bit) && pos == host) { host++; continue; }
+                state = IN_HOST;
+                tld = host;
+            }
+            if (dot & bit) {
+                tld = pos + 1;
+            } else if (nl & bit) {
+                if (pos - start >= LOGLINE_MAX - 1) {
+                    goto stop;          // Longer than the fgets() path allows
+                }
+                out[n].start = start;
+                out[n].space = space;
+                out[n].host = host;
+                out[n].tld = tld;
+                out[n].end = pos;
+                n++;
+                start = pos + 1;
+                state = IN_DATE;
+                if (n == max) { goto stop; }
+            }
+        }
+    }
+stop:
+    *used = start;
+    return n;
+}
+
+const char *scan_select(enum scan_isa isa) {
+    classify_fn fn = classify_scalar;
+    const char *name = "scalar";
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if ((isa == SCAN_AUTO || isa == SCAN_AVX2) && __builtin_cpu_supports("avx2")) {
+        fn = classify_avx2;
+        name = "avx2";
+    } else if (isa != SCAN_SCALAR && __builtin_cpu_supports("sse2")) {
+        fn = classify_sse2;
+        name = "sse2";
+    }
+#endif
+    __atomic_store_n(&classify, fn, __ATOMIC_RELEASE);
+    return name;
+}
+
+/*
+/
+/ Classifiers
+/
+*/
+
+static void classify_scalar(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot) {
+    uint64_t n = 0, s = 0, d = 0;
+    for (int i = 0; i < BLOCK; i++) {
+        n |= (uint64_t)(p[i] == '\n') << i;
+        s |= (uint64_t)(p[i] == ' ') << i;
+        d |= (uint64_t)(p[i] == '.') << i;
+    }
+    *nl = n; *sp = s; *dot = d;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static void classify_sse2(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot) {
+    const __m128i vnl = _mm_set1_epi8('\n'), vsp = _mm_set1_epi8(' '), vdot = _mm_set1_epi8('.');
+    uint64_t n = 0, s = 0, d = 0;
+    for (int i = 0; i < BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        n |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vnl)) << i;
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vsp)) << i;
+        d |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vdot)) << i;
+    }
+    *nl = n; *sp = s; *dot = d;
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *dot) {
+    const __m256i vnl = _mm256_set1_epi8('\n'), vsp = _mm256_set1_epi8(' '), vdot = _mm256_set1_epi8('.');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    *nl = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vnl))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vnl)) << 32;
+    *sp = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vsp))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vsp)) << 32;
+    *dot = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vdot))
+         | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vdot)) << 32;
+}
+#endif
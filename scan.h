@@ -0,0 +1,43 @@
+#ifndef _SCAN_H_INCLUDED_
+#define _SCAN_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct scanline ScanLine;
+
+/*
+ * the field offsets of one legal log line, relative to the buffer given to
+ * scan_lines(); the same fields as a LogLine, packed into 20 bytes
+ */
+struct scanline {
+    uint32_t start;             /* first byte of the line, the date field */
+    uint32_t space;             /* first space, so the date is start..space */
+    uint32_t host;              /* hostname, after the run of spaces */
+    uint32_t tld;               /* hostname after its last '.' */
+    uint32_t end;               /* the terminating newline */
+};
+
+/*
+ * the instruction sets scan_lines() can use; SCAN_AUTO picks the best one
+ * the running CPU supports
+ */
+enum scan_isa { SCAN_AUTO, SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+
+/*
+ * scan_lines locates the fields of up to `max' lines at the start of `buf',
+ * classifying 64 bytes at a time with vector compares, and stores them in
+ * `out'; `*used' is set to the offset of the first line not stored
+ * scanning stops early at a line that logline_parse() would reject, or at
+ * a final line with no newline, so that the caller can deal with it
+ * returns the number of lines stored
+ */
+size_t scan_lines(const char *buf, size_t len, ScanLine *out, size_t max, size_t *used);
+
+/*
+ * scan_select makes scan_lines() use `isa', or the closest one the CPU
+ * supports; returns the name of the instruction set now in use
+ */
+const char *scan_select(enum scan_isa isa);
+
+#endif /* _SCAN_H_INCLUDED_ */
@@ -0,0 +1,381 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "serve.h"
+#include "date.h"
+#include "mem.h"
+#include "report.h"
+#include "stats.h"
+
+// Macros and Enumerations
+#define SERVE_CLIENTS 64        // Connections answered at once, any more are refused
+#define SERVE_LINE 256          // Longest query, newline included
+#define SERVE_TICK 10           // Milliseconds between looks for an offered list when idle
+#define SERVE_QUEUE (1 << 22)   // Unsent reply bytes held for a client before it is dropped
+#define SERVE_BACKLOG 16
+#define MAXWORDS 4
+
+// Definitions for each structure
+struct client {
+    int fd;                     // -1 for a free slot
+    size_t have;                // Bytes of an incomplete query held in buf
+    char buf[SERVE_LINE];
+    char *out;                  // Reply bytes the socket had no room for yet
+    size_t queued, cap;
+};
+
+struct server {
+    TLDList *tld;
+    const char *path;
+    int listener;
+    pthread_t tid;
+    TLDList *offered;           // Set by serve_offer, taken back to NULL by the server thread
+    int stopping;
+    struct client clients[SERVE_CLIENTS];
+    struct pollfd fds[SERVE_CLIENTS + 1];  // The listener, then one per client slot
+};
+
+// File Specific Prototypes
+static void *server_thread(void *arg);
+static void server_take(Server *s);
+static void server_accept(Server *s);
+static void client_read(Server *s, struct client *c);
+static void client_write(struct client *c);
+static void client_close(struct client *c);
+static int answer(Server *s, struct client *c, char *query);
+static int answer_top(Server *s, struct client *c, long k, int ranged, uint32_t begin, uint32_t end);
+static int parse_window(const char *s, uint32_t *begin, uint32_t *end);
+static int reply(struct client *c, const char *head, const char *body, size_t len);
+static int send_some(int fd, struct iovec *iov, int n);
+static int enqueue(struct client *c, const void *data, size_t len);
+static int stale_socket(struct sockaddr_un *addr);
+
+Server *serve_create(const char *path, TLDList *tld) {
+    struct sockaddr_un addr;
+    Server *s;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) { return NULL; }
+    s = (Server *) mem_calloc(1, sizeof(Server));
+    if (s == NULL) { return NULL; }
+    s->tld = tld;
+    s->path = path;
+    for (int i = 0; i < SERVE_CLIENTS; i++) { s->clients[i].fd = -1; }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // A socket left behind by a server that died is in the way, a live one is not
+    if (stale_socket(&addr)) { unlink(path); }
+    s->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s->listener < 0) {
+        mem_free(s);
+        return NULL;
+    }
+    if (bind(s->listener, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(s->listener);
+        mem_free(s);
+        return NULL;
+    }
+    if (listen(s->listener, SERVE_BACKLOG) < 0 || pthread_create(&s->tid, NULL, server_thread, s) != 0) {
+        close(s->listener);
+        unlink(path);
+        mem_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+int serve_offer(Server *s, TLDList *delta) {
+    // Only this side sets the slot and only the server clears it, so a
+    // plain load and store are enough
+    if (__atomic_load_n(&s->offered, __ATOMIC_ACQUIRE) != NULL) { return 0; }
+    __atomic_store_n(&s->offered, delta, __ATOMIC_RELEASE);
+    return 1;
+}
+
+TLDList *serve_stop(Server *s) {
+    TLDList *tld = s->tld;
+
+    __atomic_store_n(&s->stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(s->tid, NULL);
+    server_take(s);
+    for (int i = 0; i < SERVE_CLIENTS; i++) {
+        if (s->clients[i].fd >= 0) { client_close(&s->clients[i]); }
+    }
+    close(s->listener);
+    unlink(s->path);
+    mem_free(s);
+    return tld;
+}
+
+// Wait for queries, merging in any list offered meanwhile before answering
+// them; a quiet socket still wakes every SERVE_TICK to look for one
+static void *server_thread(void *arg) {
+    Server *s = arg;
+
+    s->fds[0].fd = s->listener;
+    s->fds[0].events = POLLIN;
+    while (!__atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE)) {
+        // poll() passes over the slots with no client, whose fd is -1; a
+        // client with replies still queued sends no more queries until they drain
+        for (int i = 0; i < SERVE_CLIENTS; i++) {
+            s->fds[i + 1].fd = s->clients[i].fd;
+            s->fds[i + 1].events = (s->clients[i].queued > 0) ? POLLOUT : POLLIN;
+        }
+        int ready = poll(s->fds, SERVE_CLIENTS + 1, SERVE_TICK);
+        server_take(s);
+        if (ready <= 0) {
+            continue;
+        }
+        for (int i = 0; i < SERVE_CLIENTS; i++) {
+            if (s->fds[i + 1].fd < 0 || s->fds[i + 1].revents == 0) {
+                continue;
+            }
+            if (s->clients[i].queued > 0) {
+                client_write(&s->clients[i]);
+            } else {
+                client_read(s, &s->clients[i]);
+            }
+        }
+        if (s->fds[0].revents & POLLIN) {
+            server_accept(s);
+        }
+    }
+    stats_flush();
+    return NULL;
+}
+
+static void server_take(Server *s) {
+    TLDList *delta = __atomic_exchange_n(&s->offered, NULL, __ATOMIC_ACQ_REL);
+    if (delta == NULL) { return; }
+    if (!tldlist_merge(s->tld, delta)) {
+        fprintf(stderr, "Unable to merge TLD counts\n");
+    }
+    tldlist_destroy(delta);
+}
+
+// Clients never block the server thread: whatever a socket has no room for waits in the client's queue
+static void server_accept(Server *s) {
+    static const char full[] = "ERR too many connections\n";
+    int fd = accept(s->listener, NULL, NULL);
+    if (fd < 0) { return; }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        close(fd);
+        return;
+    }
+    for (int i = 0; i < SERVE_CLIENTS; i++) {
+        if (s->clients[i].fd < 0) {
+            s->clients[i].fd = fd;
+            s->clients[i].have = 0;
+            return;
+        }
+    }
+    (void) send(fd, full, sizeof(full) - 1, MSG_NOSIGNAL);
+    close(fd);
+}
+
+// Answer every complete query the client has sent, in order, keeping any
+// incomplete one for later
+static void client_read(Server *s, struct client *c) {
+    ssize_t got = read(c->fd, c->buf + c->have, SERVE_LINE - c->have);
+    char *p = c->buf, *end, *nl;
+
+    if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) { return; }
+    if (got <= 0) {
+        client_close(c);
+        return;
+    }
+    c->have += got;
+    end = c->buf + c->have;
+    while ((nl = memchr(p, '\n', end - p)) != NULL) {
+        *nl = '\0';
+        if (answer(s, c, p) < 0) {
+            client_close(c);
+            return;
+        }
+        p = nl + 1;
+    }
+    if (p == c->buf && c->have == SERVE_LINE) {
+        (void) reply(c, "ERR query too long\n", NULL, 0);
+        client_close(c);
+        return;
+    }
+    memmove(c->buf, p, end - p);
+    c->have = end - p;
+}
+
+// Send what the queue holds, as far as the socket takes it
+static void client_write(struct client *c) {
+    struct iovec iov = { c->out, c->queued };
+
+    if (send_some(c->fd, &iov, 1) < 0) {
+        client_close(c);
+        return;
+    }
+    memmove(c->out, iov.iov_base, iov.iov_len);
+    c->queued = iov.iov_len;
+}
+
+static void client_close(struct client *c) {
+    close(c->fd);
+    mem_free(c->out);
+    c->fd = -1;
+    c->have = 0;
+    c->out = NULL;
+    c->queued = c->cap = 0;
+}
+
+/*
+/
+/ Query Implementation
+/
+*/
+
+// Answers one query line; returns -1 if the client is to be dropped
+static int answer(Server *s, struct client *c, char *query) {
+    char *words[MAXWORDS], *save = NULL, *w, head[64];
+    int n = 0, ranged = 0;
+    uint32_t begin = 0, end = 0;
+    long value;
+
+    for (w = strtok_r(query, " \t\r", &save); w != NULL; w = strtok_r(NULL, " \t\r", &save)) {
+        if (n == MAXWORDS) { return reply(c, "ERR too many words\n", NULL, 0); }
+        words[n++] = w;
+    }
+    if (n == 0) {
+        return reply(c, "ERR empty query\n", NULL, 0);
+    }
+    // Every query may end with a range
+    if (n > 1 && strchr(words[n - 1], ':') != NULL) {
+        if (!parse_window(words[n - 1], &begin, &end)) { return reply(c, "ERR illegal date range\n", NULL, 0); }
+        ranged = 1;
+        n--;
+    }
+
+    if (strcmp(words[0], "COUNT") == 0 && n == 1) {
+        value = ranged ? tldlist_count_range(s->tld, begin, end) : tldlist_count(s->tld);
+    } else if (strcmp(words[0], "TLD") == 0 && n == 2) {
+        TLDNode *node = tldlist_find(s->tld, words[1], strlen(words[1]));
+        value = (node == NULL) ? 0 : ranged ? tldnode_count_range(s->tld, node, begin, end) : tldnode_count(node);
+    } else if (strcmp(words[0], "TOP") == 0 && n == 2) {
+        long k = strtol(words[1], &w, 10);
+        if (*w != '\0' || k < 1) { return reply(c, "ERR illegal top count\n", NULL, 0); }
+        return answer_top(s, c, k, ranged, begin, end);
+    } else {
+        return reply(c, "ERR unknown query\n", NULL, 0);
+    }
+    if (value < 0) {
+        // The served list always has buckets, so only their sums can have failed
+        return reply(c, "ERR out of memory\n", NULL, 0);
+    }
+    snprintf(head, sizeof(head), "OK %ld\n", value);
+    return reply(c, head, NULL, 0);
+}
+
+// The report itself, written to memory first so it can be counted
+static int answer_top(Server *s, struct client *c, long k, int ranged, uint32_t begin, uint32_t end) {
+    char *body = NULL, head[64];
+    size_t len = 0;
+    long lines = 0;
+    int status;
+    FILE *fp = open_memstream(&body, &len);
+
+    if (fp == NULL) { return reply(c, "ERR out of memory\n", NULL, 0); }
+    if (ranged) {
+        status = report_print_range(s->tld, begin, end, REPORT_BY_COUNT, k, fp);
+    } else {
+        status = report_print(s->tld, REPORT_BY_COUNT, k, fp);
+    }
+    if (fclose(fp) != 0 || status < 0) {
+        free(body);
+        return reply(c, "ERR unable to write report\n", NULL, 0);
+    }
+    for (char *p = body; (p = memchr(p, '\n', body + len - p)) != NULL; p++) { lines++; }
+    snprintf(head, sizeof(head), "OK %ld\n", lines);
+    status = reply(c, head, body, len);
+    free(body);
+    return status;
+}
+
+// Reads a "dd/mm/yyyy:dd/mm/yyyy" range, as --range takes
+static int parse_window(const char *s, uint32_t *begin, uint32_t *end) {
+    if (strlen(s) != 21 || s[10] != ':') { return 0; }
+    if (!date_parse_packed(s, begin) || !date_parse_packed(s + 11, end)) { return 0; }
+    return *begin <= *end;
+}
+
+// Sends `head' and the `len' bytes at `body', queueing whatever the socket
+// has no room for; returns -1 if the client is gone or too far behind
+static int reply(struct client *c, const char *head, const char *body, size_t len) {
+    struct iovec iov[2] = { { (void *) head, strlen(head) }, { (void *) body, len } };
+
+    // Nothing may overtake a reply already queued
+    if (c->queued == 0 && send_some(c->fd, iov, 2) < 0) { return -1; }
+    for (int i = 0; i < 2; i++) {
+        if (!enqueue(c, iov[i].iov_base, iov[i].iov_len)) { return -1; }
+    }
+    return 0;
+}
+
+// Writes the `n' buffers in as few writes as the socket allows without
+// blocking, advancing them past what was sent; returns -1 on an error
+static int send_some(int fd, struct iovec *iov, int n) {
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    for (;;) {
+        size_t left = 0;
+        for (int i = 0; i < n; i++) { left += iov[i].iov_len; }
+        if (left == 0) { return 0; }
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) { continue; }
+        if (sent < 0) { return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1; }
+        for (int i = 0; i < n; i++) {
+            size_t part = ((size_t) sent < iov[i].iov_len) ? (size_t) sent : iov[i].iov_len;
+            iov[i].iov_base = (char *) iov[i].iov_base + part;
+            iov[i].iov_len -= part;
+            sent -= part;
+        }
+    }
+}
+
+// Holds `len' more bytes for client_write(); returns 0 if that would be more than SERVE_QUEUE
+static int enqueue(struct client *c, const void *data, size_t len) {
+    if (len == 0) { return 1; }
+    if (c->queued + len > SERVE_QUEUE) { return 0; }
+    if (c->queued + len > c->cap) {
+        size_t cap = (c->cap == 0) ? SERVE_LINE : c->cap;
+        while (cap < c->queued + len) { cap *= 2; }
+        char *out = (char *) mem_realloc(c->out, cap);
+        if (out == NULL) { return 0; }
+        c->out = out;
+        c->cap = cap;
+    }
+    memcpy(c->out + c->queued, data, len);
+    c->queued += len;
+    return 1;
+}
+
+// True if `addr' names a socket nothing is listening on
+static int stale_socket(struct sockaddr_un *addr) {
+    struct stat st;
+    int fd, stale;
+
+    if (lstat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode)) { return 0; }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { return 0; }
+    stale = connect(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0 && errno == ECONNREFUSED;
+    close(fd);
+    return stale;
+}
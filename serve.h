@@ -0,0 +1,51 @@
+#ifndef _SERVE_H_INCLUDED_
+#define _SERVE_H_INCLUDED_
+
+#include "tldlist.h"
+
+typedef struct server Server;
+
+/*
+ * a Server answers queries about a resident TLDList on a UNIX stream socket,
+ * on a thread of its own, while another thread keeps counting log lines:
+ * the lines are counted into a separate list, which is handed over whole
+ * through serve_offer() and merged in by the server between queries, so
+ * neither side ever waits on the other; nor does the server wait on a
+ * client, whose replies are queued while it is slow to read them, and
+ * which is dropped if it falls too far behind
+ *
+ * each query is one line, and each reply starts with a line of "OK n" or
+ * "ERR message"; a RANGE is "dd/mm/yyyy:dd/mm/yyyy", and without one a
+ * query covers the whole window
+ *
+ *   COUNT [RANGE]      OK and the number of entries counted
+ *   TLD name [RANGE]   OK and the number of entries for that TLD
+ *   TOP k [RANGE]      OK and the number of lines that follow, the k TLDs
+ *                      with the highest counts as --sort=count --top k
+ *                      would report them
+ */
+
+/*
+ * serve_create binds a socket at `path' and starts answering queries about
+ * `tld', a list created by tldlist_create_bucketed(); the server owns `tld'
+ * until serve_stop() gives it back, and borrows `path', which must outlive it
+ * returns a pointer to the server if successful, NULL if not
+ */
+Server *serve_create(const char *path, TLDList *tld);
+
+/*
+ * serve_offer hands the counts in `delta', a list created like the
+ * server's, to the server, unless it has yet to take the last list offered;
+ * it never blocks
+ * returns 1 if the server now owns `delta', 0 if the caller still does
+ */
+int serve_offer(Server *s, TLDList *delta);
+
+/*
+ * serve_stop stops answering queries, merges any list still on offer,
+ * removes the socket and frees the server
+ * returns the list given to serve_create(), with everything offered added
+ */
+TLDList *serve_stop(Server *s);
+
+#endif /* _SERVE_H_INCLUDED_ */
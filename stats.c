@@ -0,0 +1,89 @@
+#include <time.h>
+#include "stats.h"
+
+#if TLDSTATS
+
+// Macros and Enumerations
+#define NS_PER_SEC 1e9
+
+// Definitions for each structure
+struct stats_name {
+    const char *text;           // Label for the plain report
+    const char *json;           // Key for the JSON one
+};
+
+_Thread_local struct stats stats_local;
+int stats_timing = 0;
+
+// Totals of every flushed thread, only added to with relaxed atomics
+static struct stats totals;
+
+static const struct stats_name counters[STATS_COUNTERS] = {
+    { "lines read",          "lines" },
+    { "bytes read",          "bytes" },
+    { "rejected malformed",  "rejected_malformed" },
+    { "rejected too long",   "rejected_too_long" },
+    { "skipped bad date",    "skipped_bad_date" },
+    { "out of date range",   "out_of_range" },
+    { "new keys",            "new_keys" },
+    { "avl rotations",       "rotations" },
+    { "max tree depth",      "max_depth" },
+};
+
+static const struct stats_name phases[STATS_PHASES] = {
+    { "read seconds",        "read_seconds" },
+    { "parse seconds",       "parse_seconds" },
+    { "insert seconds",      "insert_seconds" },
+    { "report seconds",      "report_seconds" },
+};
+
+uint64_t stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void stats_flush(void) {
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        unsigned long v = stats_local.counter[i];
+        if (i == STATS_MAX_DEPTH) {
+            unsigned long seen = __atomic_load_n(&totals.counter[i], __ATOMIC_RELAXED);
+            while (v > seen && !__atomic_compare_exchange_n(&totals.counter[i], &seen, v, 1,
+                                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                ;
+            }
+        } else {
+            __atomic_fetch_add(&totals.counter[i], v, __ATOMIC_RELAXED);
+        }
+        stats_local.counter[i] = 0;
+    }
+    for (int i = 0; i < STATS_PHASES; i++) {
+        __atomic_fetch_add(&totals.ns[i], stats_local.ns[i], __ATOMIC_RELAXED);
+        stats_local.ns[i] = 0;
+    }
+}
+
+void stats_print(FILE *fp, int json, unsigned long allocations) {
+    // Phase times are summed over threads, so with -j they can exceed the wall clock
+    if (json) {
+        fputc('{', fp);
+        for (int i = 0; i < STATS_COUNTERS; i++) {
+            fprintf(fp, "\"%s\": %lu, ", counters[i].json, totals.counter[i]);
+        }
+        fprintf(fp, "\"allocations\": %lu", allocations);
+        for (int i = 0; i < STATS_PHASES; i++) {
+            fprintf(fp, ", \"%s\": %.6f", phases[i].json, totals.ns[i] / NS_PER_SEC);
+        }
+        fputs("}\n", fp);
+        return;
+    }
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        fprintf(fp, "%-20s %lu\n", counters[i].text, totals.counter[i]);
+    }
+    fprintf(fp, "%-20s %lu\n", "heap allocations", allocations);
+    for (int i = 0; i < STATS_PHASES; i++) {
+        fprintf(fp, "%-20s %.6f\n", phases[i].text, totals.ns[i] / NS_PER_SEC);
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * counters for the hot paths, kept per thread so that counting costs a
+ * plain add; building with TLDSTATS=0 (make STATS=0) compiles every
+ * STATS_ macro to nothing
+ */
+#ifndef TLDSTATS
+#define TLDSTATS 1
+#endif
+
+enum stats_counter {
+    STATS_LINES,                /* log lines counted */
+    STATS_BYTES,                /* bytes of log consumed */
+    STATS_MALFORMED,            /* lines rejected for a missing space or newline */
+    STATS_TOO_LONG,             /* lines rejected for exceeding LOGLINE_MAX */
+    STATS_BAD_DATE,             /* lines skipped for an unparseable date */
+    STATS_OUT_OF_RANGE,         /* entries dated outside the list's window */
+    STATS_NEW_KEYS,             /* TLDs first seen by an add */
+    STATS_ROTATIONS,            /* single AVL rotations, a double one is two */
+    STATS_MAX_DEPTH,            /* deepest AVL insertion, a maximum not a sum */
+    STATS_COUNTERS
+};
+
+enum stats_phase { STATS_READ, STATS_PARSE, STATS_INSERT, STATS_REPORT, STATS_PHASES };
+
+#if TLDSTATS
+
+struct stats {
+    unsigned long counter[STATS_COUNTERS];
+    uint64_t ns[STATS_PHASES];
+};
+
+extern _Thread_local struct stats stats_local;
+extern int stats_timing;
+
+#define STATS_ADD(c, n) (stats_local.counter[(c)] += (n))
+#define STATS_MAX(c, n) do { if ((unsigned long)(n) > stats_local.counter[(c)]) stats_local.counter[(c)] = (n); } while (0)
+#define STATS_START(t) uint64_t t = stats_timing ? stats_clock() : 0
+#define STATS_STOP(p, t) do { if (stats_timing) stats_local.ns[(p)] += stats_clock() - (t); } while (0)
+
+/*
+ * stats_clock returns a monotonic time in nanoseconds; phases are only
+ * timed once stats_timing has been set, so an unwatched run never reads
+ * the clock
+ */
+uint64_t stats_clock(void);
+
+/*
+ * stats_flush adds the calling thread's counters into the process totals
+ * and clears them; every thread that counted must call it before
+ * stats_print()
+ */
+void stats_flush(void);
+
+/*
+ * stats_print writes the process totals to `fp' as "name value" lines, or
+ * as one JSON object if `json' is set; `allocations' is reported with them
+ */
+void stats_print(FILE *fp, int json, unsigned long allocations);
+
+#else
+
+#define STATS_ADD(c, n) ((void) sizeof (n))
+#define STATS_MAX(c, n) ((void) sizeof (n))
+#define STATS_START(t)
+#define STATS_STOP(p, t) ((void) 0)
+#define stats_flush() ((void) 0)
+
+#endif
+
+#endif /* _STATS_H_INCLUDED_ */
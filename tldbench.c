@@ -0,0 +1,453 @@
+#include "date.h"
+#include "tldlist.h"
+#include "ctldlist.h"
+#include "ingest.h"
+#include "logline.h"
+#include "scan.h"
+#include "report.h"
+#include "mem.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*
+ * tldbench times the phases of a TLD count over a log in process, for each
+ * TLDList backend, then runs the tldmonitor binary over the same log for
+ * each backend with and without threads, checking its output against a
+ * reference report such as gendata -r writes
+ *
+ * with -c it instead stress tests a CTLDList: each of the threads counts
+ * the whole log into the one shared list while another walks it, and the
+ * counts are checked against a single-threaded TLDList; make tsan runs
+ * this under ThreadSanitizer
+ *
+ * with -o it instead checks what each backend answers in order without
+ * sorting, batch iteration and the tree's rank and select queries, against
+ * a snapshot sorted by name; make check runs this
+ */
+
+#define USAGE "usage: %s [-x tldmonitor] [-r reference] [-j threads] [-c threads | -o] begin_datestamp end_datestamp file\n"
+#define MAXSTRESS 64
+#define STRESSBATCH 256
+#define ORDERBATCH 7            /* entries per tldlist_iter_next_batch, so that batches straddle */
+#ifndef TLDBENCH_CFLAGS
+#define TLDBENCH_CFLAGS "unknown"   /* the Makefile passes its CFLAGS, so timings say how they were built */
+#endif
+
+struct stress {
+    CTLDList *shared;
+    const char *buf;
+    size_t len;
+    long walks;                 /* for the walker: lists walked, and */
+    long regressions;           /* walks that summed less than the one before */
+};
+
+static int stopping = 0;        /* set, atomically, once the adding threads are done */
+
+static const char *backends[] = { "avl", "hash" };
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * phases counts `buf' into a new list of `backend', timing the adds, a
+ * plain walk of the iterator and a sorted report to /dev/null
+ */
+static int phases(enum tldlist_backend backend, Date *begin, Date *end, const char *buf, size_t len) {
+    TLDList *tld = tldlist_create_backend(begin, end, backend);
+    TLDIterator *it;
+    TLDNode *node;
+    FILE *null = fopen("/dev/null", "w");
+    const char *bad = NULL;
+    unsigned long lines = 0, allocs = mem_allocations();
+    long sum = 0;
+    double t0, t1, t2, t3;
+
+    if (tld == NULL || null == NULL)
+        return -1;
+    t0 = now();
+    ingest_lines(tld, buf, len, 1, &bad, &lines);
+    t1 = now();
+    it = tldlist_iter_create(tld);
+    while ((node = tldlist_iter_next(it)) != NULL)
+        sum += tldnode_count(node);
+    tldlist_iter_destroy(it);
+    t2 = now();
+    report_print(tld, REPORT_BY_COUNT, 0, null);
+    t3 = now();
+    allocs = mem_allocations() - allocs;
+
+    printf("%-5s add %8.2f ns/line %8.2f Mlines/s   iterate %8.3f ms   report %8.3f ms   %.6f allocs/line\n",
+           backends[backend], (t1 - t0) * 1e9 / lines, lines / (t1 - t0) / 1e6,
+           (t2 - t1) * 1e3, (t3 - t2) * 1e3, (double)allocs / lines);
+    if (bad != NULL || sum != tldlist_count(tld))
+        printf("%-5s stopped early or miscounted\n", backends[backend]);
+    tldlist_destroy(tld);
+    fclose(null);
+    return 0;
+}
+
+/*
+ * stress_add counts the whole log into the shared list, a scanned batch at
+ * a time; illegal lines are skipped rather than stopping the count
+ */
+static void *stress_add(void *arg) {
+    struct stress *st = arg;
+    ScanLine fields[STRESSBATCH];
+    TLDHost hosts[STRESSBATCH];
+    const char *p = st->buf, *end = st->buf + st->len, *nl;
+    size_t i, k, n, used;
+
+    while (p < end) {
+        n = scan_lines(p, end - p, fields, STRESSBATCH, &used);
+        for (i = k = 0; i < n; i++) {
+            if (fields[i].space - fields[i].start < 10 || !date_parse_packed(p + fields[i].start, &hosts[k].date))
+                continue;
+            hosts[k].host = p + fields[i].host;
+            hosts[k].hostlen = fields[i].end - fields[i].host;
+            hosts[k++].tldlen = fields[i].end - fields[i].tld;
+        }
+        ctldlist_add_batch(st->shared, hosts, k);
+        p += used;
+        if (n < STRESSBATCH && p < end) {
+            nl = memchr(p, '\n', end - p);
+            p = (nl == NULL) ? end : nl + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * stress_walk iterates the shared list until the adders are done; counts
+ * only grow and nodes are only added, so each walk must sum to at least
+ * as much as the last
+ */
+static void *stress_walk(void *arg) {
+    struct stress *st = arg;
+    long last = 0, sum;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        CTLDIterator *it = ctldlist_iter_create(st->shared);
+        CTLDNode *node;
+        if (it == NULL)
+            break;
+        for (sum = 0; (node = ctldlist_iter_next(it)) != NULL; )
+            sum += ctldnode_count(node);
+        ctldlist_iter_destroy(it);
+        if (sum < last)
+            st->regressions++;
+        last = sum;
+        st->walks++;
+    }
+    return NULL;
+}
+
+/*
+ * stress runs `nthreads' adders and a walker over one CTLDList, then
+ * checks that every TLD was counted exactly `nthreads' times as often as
+ * a single-threaded TLDList counts it
+ * returns 0 if the counts agree, -1 if not
+ */
+static int stress(int nthreads, Date *begin, Date *end, const char *buf, size_t len) {
+    struct stress st[MAXSTRESS + 1];
+    pthread_t tids[MAXSTRESS + 1];
+    TLDList *ref = tldlist_create_backend(begin, end, TLDLIST_HASH);
+    TLDList *merged = tldlist_create_backend(begin, end, TLDLIST_HASH);
+    CTLDList *shared = NULL;
+    TLDSnapshot *a = NULL, *b = NULL;
+    const char *bad = NULL;
+    unsigned long lines = 0;
+    int i, started, status = -1;
+    double t0, t1;
+
+    if (ref == NULL || merged == NULL)
+        goto done;
+    ingest_lines(ref, buf, len, 1, &bad, &lines);
+    shared = ctldlist_create(begin, end, tldlist_size(ref));
+    if (shared == NULL)
+        goto done;
+    t0 = now();
+    for (started = 0; started <= nthreads; started++) {
+        st[started] = (struct stress){ shared, buf, len, 0, 0 };
+        if (pthread_create(&tids[started], NULL, (started < nthreads) ? stress_add : stress_walk, &st[started]) != 0)
+            break;
+    }
+    for (i = 0; i < started && i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+    t1 = now();
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    for (; i < started; i++)
+        pthread_join(tids[i], NULL);
+    if (started <= nthreads) {
+        fprintf(stderr, "Unable to start stress threads\n");
+        goto done;
+    }
+
+    printf("shared -c %-3d %8.3f s %8.2f Mlines/s   %ld TLDs   %ld walks   %ld regressions\n",
+           nthreads, t1 - t0, lines * nthreads / (t1 - t0) / 1e6, ctldlist_size(shared),
+           st[nthreads].walks, st[nthreads].regressions);
+
+    // Every TLD should have been counted once per thread, no more and no less
+    if (!ctldlist_merge(merged, shared))
+        goto done;
+    a = tldlist_snapshot(ref, TLDLIST_BY_NAME);
+    b = tldlist_snapshot(merged, TLDLIST_BY_NAME);
+    if (a == NULL || b == NULL)
+        goto done;
+    status = (tldsnapshot_size(a) == tldsnapshot_size(b) && st[nthreads].regressions == 0) ? 0 : -1;
+    for (long j = 0; status == 0 && j < tldsnapshot_size(a); j++) {
+        TLDEntry *x = &tldsnapshot_entries(a)[j], *y = &tldsnapshot_entries(b)[j];
+        if (strcmp(x->name, y->name) != 0 || x->count * nthreads != y->count)
+            status = -1;
+    }
+    printf("shared counts %s\n", (status == 0) ? "ok" : "WRONG");
+
+done:
+    if (a != NULL)
+        tldsnapshot_destroy(a);
+    if (b != NULL)
+        tldsnapshot_destroy(b);
+    if (shared != NULL)
+        ctldlist_destroy(shared);
+    if (merged != NULL)
+        tldlist_destroy(merged);
+    if (ref != NULL)
+        tldlist_destroy(ref);
+    return status;
+}
+
+/*
+ * in_order checks the list `tld' of `backend' against its own snapshot
+ * sorted by name: batch iteration returns what the plain iterator does, and
+ * on the tree each TLD's count_below is the sum of the counts sorted before
+ * it, and select finds it for the first and the last of its entries
+ * returns 0 if everything agrees, -1 if not
+ */
+static int in_order(TLDList *tld, enum tldlist_backend backend) {
+    TLDSnapshot *snap = tldlist_snapshot(tld, TLDLIST_BY_NAME);
+    TLDIterator *plain = tldlist_iter_create(tld), *batched = tldlist_iter_create(tld);
+    TLDEntry batch[ORDERBATCH], *sorted;
+    TLDNode *node;
+    long got, seen = 0, below = 0, n;
+    int status = -1;
+
+    if (snap == NULL || plain == NULL || batched == NULL)
+        goto done;
+    while ((got = tldlist_iter_next_batch(batched, batch, ORDERBATCH)) > 0) {
+        for (long i = 0; i < got; i++, seen++) {
+            node = tldlist_iter_next(plain);
+            if (node == NULL || strcmp(batch[i].name, tldnode_tldname(node)) != 0 ||
+                batch[i].count != tldnode_count(node))
+                goto done;
+        }
+    }
+    if (tldlist_iter_next(plain) != NULL || seen != tldlist_size(tld))
+        goto done;
+
+    sorted = tldsnapshot_entries(snap);
+    n = tldsnapshot_size(snap);
+    if (backend != TLDLIST_AVL) {
+        status = (tldlist_count_below(tld, "") == -1 && tldlist_select(tld, 1) == NULL) ? 0 : -1;
+        goto done;
+    }
+    for (long j = 0; j < n; j++) {
+        if (tldlist_count_below(tld, sorted[j].name) != below)
+            goto done;
+        node = tldlist_select(tld, below + 1);
+        if (node == NULL || strcmp(tldnode_tldname(node), sorted[j].name) != 0)
+            goto done;
+        node = tldlist_select(tld, below + sorted[j].count);
+        if (node == NULL || strcmp(tldnode_tldname(node), sorted[j].name) != 0)
+            goto done;
+        below += sorted[j].count;
+    }
+    status = (below == tldlist_count(tld) && tldlist_select(tld, 0) == NULL && tldlist_select(tld, below + 1) == NULL) ? 0 : -1;
+
+done:
+    if (batched != NULL)
+        tldlist_iter_destroy(batched);
+    if (plain != NULL)
+        tldlist_iter_destroy(plain);
+    if (snap != NULL)
+        tldsnapshot_destroy(snap);
+    return status;
+}
+
+/*
+ * orders counts the log into a list of each backend, checking it with
+ * in_order() halfway, as a query between adds would find it, and at the end
+ * returns 0 if every check passed, -1 if not
+ */
+static int orders(Date *begin, Date *end, const char *buf, size_t len) {
+    const char *half = memchr(buf + len / 2, '\n', len - len / 2), *bad = NULL;
+    size_t first = (half == NULL) ? len : (size_t)(half + 1 - buf);
+    unsigned long lines = 0;
+    int status = 0;
+
+    for (int b = TLDLIST_AVL; b <= TLDLIST_HASH; b++) {
+        TLDList *tld = tldlist_create_backend(begin, end, b);
+        int ok;
+        if (tld == NULL)
+            return -1;
+        ingest_lines(tld, buf, first, 1, &bad, &lines);
+        ok = in_order(tld, b) == 0;
+        ingest_lines(tld, buf + first, len - first, 1, &bad, &lines);
+        ok = ok && in_order(tld, b) == 0;
+        printf("%-5s %ld TLDs, %ld entries, in order %s\n", backends[b], tldlist_size(tld), tldlist_count(tld),
+               ok ? "ok" : "WRONG");
+        if (!ok)
+            status = -1;
+        tldlist_destroy(tld);
+    }
+    return status;
+}
+
+/*
+ * same reports whether the files `a' and `b' have identical contents
+ */
+static int same(const char *a, const char *b) {
+    FILE *f1 = fopen(a, "r"), *f2 = fopen(b, "r");
+    int c1 = 0, c2 = 0;
+
+    if (f1 != NULL && f2 != NULL) {
+        do {
+            c1 = getc(f1);
+            c2 = getc(f2);
+        } while (c1 == c2 && c1 != EOF);
+    }
+    if (f1 != NULL)
+        fclose(f1);
+    if (f2 != NULL)
+        fclose(f2);
+    return f1 != NULL && f2 != NULL && c1 == c2;
+}
+
+/*
+ * run times one tldmonitor --sort=count over `file', reporting its peak
+ * RSS, and compares its output with `reference' if there is one
+ * returns 0 if the run succeeded and matched, -1 if not
+ */
+static int run(const char *prog, const char *backend, const char *threads, char *argv[],
+               const char *reference, unsigned long lines) {
+    char out[] = "/tmp/benchXXXXXX";
+    struct rusage ru;
+    double t0, t1;
+    int fd = mkstemp(out), status, ok;
+    pid_t pid;
+
+    if (fd < 0)
+        return -1;
+    t0 = now();
+    pid = fork();
+    if (pid == 0) {
+        dup2(fd, 1);
+        execl(prog, prog, "--sort=count", "-b", backend, "-j", threads, argv[0], argv[1], argv[2], (char *)NULL);
+        _exit(127);
+    }
+    close(fd);
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0) {
+        unlink(out);
+        return -1;
+    }
+    t1 = now();
+    ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && (reference == NULL || same(out, reference));
+    printf("tldmonitor -b %-4s -j %-3s %8.3f s %8.2f ns/line %8.2f Mlines/s   peak RSS %8ld KB   %s\n",
+           backend, threads, t1 - t0, (t1 - t0) * 1e9 / lines, lines / (t1 - t0) / 1e6, ru.ru_maxrss,
+           !ok ? "FAILED" : (reference != NULL) ? "output ok" : "");
+    unlink(out);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *prog = "./tldmonitor", *reference = NULL, *threads = "4";
+    char *name = argv[0];
+    Date *begin, *end;
+    struct stat st;
+    struct rusage ru;
+    const char *buf, *p;
+    unsigned long lines = 0;
+    int fd, opt, status = 0, stressing = 0, ordering = 0;
+
+    while ((opt = getopt(argc, argv, "x:r:j:c:o")) != -1) {
+        switch (opt) {
+        case 'x': prog = optarg; break;
+        case 'r': reference = optarg; break;
+        case 'j': threads = optarg; break;
+        case 'c':
+            stressing = atoi(optarg);
+            if (stressing < 1 || stressing > MAXSTRESS) {
+                fprintf(stderr, "Illegal stress thread count: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'o': ordering = 1; break;
+        default:
+            fprintf(stderr, USAGE, name);
+            return -1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 3) {
+        fprintf(stderr, USAGE, name);
+        return -1;
+    }
+    begin = date_create(argv[0]);
+    end = date_create(argv[1]);
+    if (begin == NULL || end == NULL) {
+        fprintf(stderr, "Illegal date\n");
+        return -1;
+    }
+    fd = open(argv[2], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "Unable to open %s\n", argv[2]);
+        return -1;
+    }
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", argv[2]);
+        return -1;
+    }
+    for (p = buf; (p = memchr(p, '\n', buf + st.st_size - p)) != NULL; p++)
+        lines++;
+    printf("# %s: %lu lines, %.1f MB\n", argv[2], lines, st.st_size / 1e6);
+
+    // Fault the file in first so that no phase pays for the page cache
+    madvise((void *)buf, st.st_size, MADV_WILLNEED);
+    if (stressing > 0 || ordering) {
+        status = ordering ? orders(begin, end, buf, st.st_size) : stress(stressing, begin, end, buf, st.st_size);
+        munmap((void *)buf, st.st_size);
+        date_destroy(begin);
+        date_destroy(end);
+        return status;
+    }
+    printf("# built with %s\n", TLDBENCH_CFLAGS);
+    for (int b = TLDLIST_AVL; b <= TLDLIST_HASH; b++)
+        if (phases(b, begin, end, buf, st.st_size) < 0)
+            status = -1;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("in-process peak RSS %ld KB\n", ru.ru_maxrss);
+
+    for (int b = TLDLIST_AVL; b <= TLDLIST_HASH; b++) {
+        if (run(prog, backends[b], "1", argv, reference, lines) < 0)
+            status = -1;
+        if (run(prog, backends[b], threads, argv, reference, lines) < 0)
+            status = -1;
+    }
+    munmap((void *)buf, st.st_size);
+    date_destroy(begin);
+    date_destroy(end);
+    return status;
+}
@@ -6,38 +6,90 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <strings.h>
 #include "tldlist.h"
 #include "date.h"
-
+#include "mem.h"
+#include "arena.h"
+#include "stats.h"
+#include "hll.h"
+#include "tldtable.h"
+#include "logline.h"
+
+// Macros and Enumerations
+#define HASH_INITIAL 64         // Must be a power of two
+#define NODE_SLAB 64            // Nodes in the first slab, later slabs double
+#define NAME_POOL 512           // Bytes in the first string pool block
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+#define ADD_BLOCK 256           // Entries tldlist_add_batch filters and hashes at a time
+#define PREFETCH_AHEAD 8        // Lookups between prefetching a key's slot and using it
 
 // Definitions for each structure
+struct tldslot {
+    unsigned long hash;
+    struct tldnode *node;
+};
+
 struct tldlist {
-    struct date *begin;
-    struct date *end;
+    uint32_t first_day;         // begin and end packed, see date_pack
+    uint32_t last_day;
     struct tldnode *root;
+    struct tldnode *first;
+    struct tldnode *last;
+    enum tldlist_backend backend;
+    struct tldslot *slots;
+    unsigned long capacity;
+    unsigned long used;
+    Arena *nodes;               // Slab every TLDNode is carved from
+    Arena *names;               // Bump-allocated pool for the TLD strings
+    long total;                 // Running tally for tldlist_count
+    long size;                  // Number of distinct TLDs
+    long day0;                  // Day number of begin, see date_days
+    long ndays;                 // Days in the window if bucketed, else 0
+    long *days;                 // Entries per day over the whole list
+    long *prefix;               // Prefix sums of days, valid unless stale
+    int stale;                  // Set by every add, cleared by tldlist_prefix
+    Arena *buckets;             // Per-node day buckets and prefix sums
+    LabelTrie *trie;            // Domain suffix counts, if given a depth
+    HostTable *hosts;           // Full hostname counts, if kept
+    Arena *sketches;            // Per-node HyperLogLog registers, if kept
+    TLDNode **known_nodes;      // The node of each known TLD the list has seen, by tldtable index
+};
+
+struct tldsnapshot {
+    long size;
+    long total;
+    TLDEntry *entries;          // Straight after this header, the names after them
 };
 
 struct tldnode {
     struct tldnode *right;
     struct tldnode *left;
     struct tldnode *parent;
+    struct tldnode *next;
     char *tld;
     long count;
+    long sum;                   // Count of this node plus both subtrees
     long height;
     long balance;
+    long *days;                 // Entries per day, bucketed lists only
+    long *prefix;               // Prefix sums of days, built on demand
+    uint8_t *sketch;            // Distinct hostnames, lists with sketches only
 };
 
 struct tlditerator {
     struct tldnode *pointer;
+    enum tldlist_backend backend;
 } ;
 
 // File Specific Prototypes
 // Tree Impementation
-TLDNode *tldnode_create(char *tld, TLDNode *parent);
-void tldlist_inorder_count(TLDNode *node, long *tally);
-void tldnode_destory(TLDNode *node);
-void tldnode_destory_recursive(TLDNode *node);
+TLDNode *tldnode_create(TLDList *list, const char *tld, size_t len, TLDNode *parent);
+TLDNode *tldlist_insert(TLDList *tld, const char *name, size_t len, long count);
+TLDNode *tldtree_insert(TLDList *tld, const char *name, size_t len, long count);
+TLDNode *tldlist_known(TLDList *tld, long index, long count);
+void tldlist_append(TLDList *tld, TLDNode *node);
 // AVL Implementations
 TLDNode *right_rotate(TLDNode *grandparent);
 TLDNode *left_rotate(TLDNode *grandparent);
@@ -47,10 +99,24 @@ void setbalance(TLDNode *node);
 void rebalance(TLDNode *node, TLDList *list);
 int height(TLDNode *node);
 void reheight(TLDNode *node);
+void resum(TLDNode *node);
+long subtree_sum(TLDNode *node);
+TLDNode *tldlist_count_node(TLDList *tld, const char *tldname, size_t len, uint32_t date, long count);
+long tldlist_add_block(TLDList *tld, const TLDHost *hosts, size_t n);
+void tldlist_bucket(TLDList *tld, TLDNode *node, uint32_t date, long count);
+int tldlist_host(TLDList *tld, TLDNode *node, const char *host, size_t hostlen);
+// Snapshot Implementations
+char *snapshot_entry(TLDEntry *entry, TLDNode *node, char *pool);
+// Day Bucket Implementations
+long prefix_range(TLDList *tld, long *prefix, uint32_t begin, uint32_t end);
 long max(int a, int b);
 //  String Based Implementions
-char *tldstrip(char *s);
-int strcompare(const char *s1, const char *s2);
+int strcompare(const char *s1, size_t n1, const char *s2);
+// Hash Table Implementations
+TLDNode *tldhash_insert(TLDList *tld, const char *name, size_t len, long count);
+TLDNode *tldhash_insert_hashed(TLDList *tld, const char *name, size_t len, unsigned long hash, long count);
+int tldhash_grow(TLDList *tld);
+unsigned long tldhash(const char *s, size_t len);
 
 /*
 /
@@ -59,92 +125,436 @@ int strcompare(const char *s1, const char *s2);
 */
 
 TLDList *tldlist_create(Date *begin, Date *end) {
+    return tldlist_create_backend(begin, end, TLDLIST_DEFAULT_BACKEND);
+}
+
+TLDList *tldlist_create_backend(Date *begin, Date *end, enum tldlist_backend backend) {
 
     // Assign space for new list in the heap
-    TLDList *list = (TLDList *) malloc(sizeof(TLDList));
+    TLDList *list = (TLDList *) mem_malloc(sizeof(TLDList));
     if (list == NULL) { return NULL; }
     
     TLDNode *root = NULL;
     // If Malloc fails for either of the calls, return null
-    if (begin == NULL || end == NULL) { free(list); return NULL; }
+    if (begin == NULL || end == NULL) { mem_free(list); return NULL; }
 
     // Ensure the start date is less than the end data
-    if (date_compare(begin, end) > 0) { free(list); return NULL; }
+    if (date_compare(begin, end) > 0) { mem_free(list); return NULL; }
 
     // Assign new pointers as members of list
-    list->begin     = begin;
-    list->end       = end;
+    list->first_day = date_pack(begin);
+    list->last_day  = date_pack(end);
     list->root      = root;
+    list->first     = NULL;
+    list->last      = NULL;
+    list->backend   = backend;
+    list->slots     = NULL;
+    list->capacity  = 0;
+    list->used      = 0;
+    list->total     = 0;
+    list->size      = 0;
+    list->day0      = 0;
+    list->ndays     = 0;
+    list->days      = NULL;
+    list->prefix    = NULL;
+    list->stale     = 0;
+    list->buckets   = NULL;
+    list->trie      = NULL;
+    list->hosts     = NULL;
+    list->sketches  = NULL;
+
+    // Known TLDs find their nodes in a flat array indexed by the generated table
+    list->known_nodes = (TLDNode **) mem_calloc(tldtable_size, sizeof(TLDNode *));
+    if (list->known_nodes == NULL) { tldlist_destroy(list); return NULL; }
+
+    // Nodes and their names live in the list's own arenas, freed all at once
+    list->nodes = arena_create(NODE_SLAB * sizeof(TLDNode));
+    list->names = arena_create(NAME_POOL);
+    if (list->nodes == NULL || list->names == NULL) { tldlist_destroy(list); return NULL; }
+
+    // The hash table backend needs its slot array up front
+    if (backend == TLDLIST_HASH) {
+        list->slots = (struct tldslot *) mem_calloc(HASH_INITIAL, sizeof(struct tldslot));
+        if (list->slots == NULL) { tldlist_destroy(list); return NULL; }
+        list->capacity = HASH_INITIAL;
+    }
     return list;
 }
 
+TLDList *tldlist_create_bucketed(Date *begin, Date *end, enum tldlist_backend backend) {
+    TLDList *list = tldlist_create_backend(begin, end, backend);
+    if (list == NULL) { return NULL; }
+
+    // One bucket per day of the window, for the list and then for each node as it's created
+    list->day0    = date_days(list->first_day);
+    list->ndays   = date_days(list->last_day) - list->day0 + 1;
+    list->days    = (long *) mem_calloc(list->ndays, sizeof(long));
+    list->prefix  = (long *) mem_calloc(list->ndays + 1, sizeof(long));
+    list->buckets = arena_create(NODE_SLAB * list->ndays * sizeof(long));
+    if (list->ndays < 1 || list->days == NULL || list->prefix == NULL || list->buckets == NULL) {
+        tldlist_destroy(list);
+        return NULL;
+    }
+    return list;
+}
+
+int tldlist_set_depth(TLDList *tld, int depth) {
+    if (tld->trie != NULL || tld->total > 0) { return 0; }
+    tld->trie = labeltrie_create(depth);
+    return tld->trie != NULL;
+}
+
+int tldlist_set_hosts(TLDList *tld, size_t max_mem) {
+    if (tld->hosts != NULL || tld->total > 0) { return 0; }
+    tld->hosts = hosttable_create(max_mem);
+    return tld->hosts != NULL;
+}
+
+int tldlist_set_distinct(TLDList *tld) {
+    if (tld->sketches != NULL || tld->total > 0) { return 0; }
+    tld->sketches = arena_create(NODE_SLAB * HLL_REGISTERS);
+    return tld->sketches != NULL;
+}
+
+int tldlist_has_sketches(TLDList *tld) {
+    return tld->sketches != NULL;
+}
+
+LabelTrie *tldlist_trie(TLDList *tld) {
+    return tld->trie;
+}
+
+HostTable *tldlist_hosts(TLDList *tld) {
+    return tld->hosts;
+}
+
 void tldlist_destroy(TLDList *tld) {
-    // Free all nodes in tree from heap
-    tldnode_destory_recursive(tld->root);
+    // Every node and name came from the arenas, so there is no tree to walk
+    if (tld->nodes != NULL) { arena_destroy(tld->nodes); }
+    if (tld->names != NULL) { arena_destroy(tld->names); }
+    if (tld->buckets != NULL) { arena_destroy(tld->buckets); }
+    if (tld->trie != NULL) { labeltrie_destroy(tld->trie); }
+    if (tld->hosts != NULL) { hosttable_destroy(tld->hosts); }
+    if (tld->sketches != NULL) { arena_destroy(tld->sketches); }
+    mem_free(tld->days);
+    mem_free(tld->prefix);
+    mem_free(tld->slots);
+    mem_free(tld->known_nodes);
 
     // Finally, free the list from memory from heap
-    free(tld);
+    mem_free(tld);
 }
 
-void tldnode_destory_recursive(TLDNode *node) {
+int tldlist_add(TLDList *tld, char *hostname, Date *d) {
 
-    // This function recursively frees all linked nodes from a given input node
-    // Base case: Node points to Null
-    if (node == NULL) { return; }
-    // First Case: Node's children points to null
-    else if (node->left == NULL && node->right == NULL) { tldnode_destory(node); }
-    // Second Case: Node's left child full but right child null
-    else if (node->left != NULL && node->right == NULL) {
-        tldnode_destory_recursive(node->left);
-        tldnode_destory(node);
+    // Condition Check: See if given date is within user's time peroid
+    if (d == NULL || hostname == NULL || tld == NULL) { 
+        return 0; 
     }
-    // Third Case: Node's right child full but left child null
-    else if (node->left == NULL && node->right != NULL) {
-        tldnode_destory_recursive(node->right);
-        tldnode_destory(node);
+
+    // So we need the domain's TLD, which is everything after the last dot
+    char *name = strrchr(hostname, '.');
+    name = (name == NULL) ? hostname : name + 1;
+    return tldlist_add_packed(tld, name, strlen(name), date_pack(d));
+}
+
+int tldlist_add_tld(TLDList *tld, const char *tldname, size_t len, Date *d) {
+    if (d == NULL) { 
+        return 0; 
     }
-    // Fourth Case: Node has both full children
-    else if (node->left != NULL && node->right != NULL) {
-        tldnode_destory_recursive(node->left);
-        tldnode_destory_recursive(node->right);
-        tldnode_destory(node);
+    return tldlist_add_packed(tld, tldname, len, date_pack(d));
+}
+
+int tldlist_add_packed(TLDList *tld, const char *tldname, size_t len, uint32_t date) {
+    return tldlist_add_count(tld, tldname, len, date, 1);
+}
+
+int tldlist_add_host(TLDList *tld, const char *host, size_t hostlen, size_t tldlen, uint32_t date) {
+    TLDNode *node = tldlist_count_node(tld, host + hostlen - tldlen, tldlen, date, 1);
+    if (node == NULL) {
+        return 0;
     }
+    return tldlist_host(tld, node, host, hostlen);
 }
 
-int tldlist_add(TLDList *tld, char *hostname, Date *d) {
+long tldlist_add_batch(TLDList *tld, const TLDHost *hosts, size_t n) {
+    long counted = 0;
+    for (size_t i = 0; i < n; i += ADD_BLOCK) {
+        counted += tldlist_add_block(tld, hosts + i, (n - i < ADD_BLOCK) ? n - i : ADD_BLOCK);
+    }
+    return counted;
+}
 
-    // Local Variable to keep track of successful addition
-    short int success = -1;
+// tldlist_add_batch for at most ADD_BLOCK entries
+long tldlist_add_block(TLDList *tld, const TLDHost *hosts, size_t n) {
+    const TLDHost *keep[ADD_BLOCK];
+    unsigned long hashes[ADD_BLOCK];
+    long known[ADD_BLOCK];
+    size_t i, m = 0;
+    long counted = 0;
+
+    // Filter the whole block on its dates first, so the lookups run back to back
+    for (i = 0; i < n; i++) {
+        if (hosts[i].date < tld->first_day || hosts[i].date > tld->last_day) {
+            STATS_ADD(STATS_OUT_OF_RANGE, 1);
+        } else {
+            keep[m++] = &hosts[i];
+        }
+    }
 
-    // Condition Check: See if given date is within user's time peroid
-    if (d == NULL || hostname == NULL || tld == NULL) { 
-        return 0; 
+    // Then look every key up in the table of known TLDs, and hash the rest
+    // at once, each one independent of the last, so that their slots can be
+    // fetched ahead of the probes that need them
+    for (i = 0; i < m; i++) {
+        known[i] = tldtable_find(keep[i]->host + keep[i]->hostlen - keep[i]->tldlen, keep[i]->tldlen);
     }
-    if (date_compare(d,tld->begin) < 0 || date_compare(d,tld->end) > 0) { 
-        return 0; 
+    if (tld->backend == TLDLIST_HASH) {
+        for (i = 0; i < m; i++) {
+            if (known[i] < 0) {
+                hashes[i] = tldhash(keep[i]->host + keep[i]->hostlen - keep[i]->tldlen, keep[i]->tldlen);
+            }
+        }
+        for (i = 0; i < m && i < PREFETCH_AHEAD; i++) {
+            if (known[i] < 0) { __builtin_prefetch(&tld->slots[hashes[i] & (tld->capacity - 1)]); }
+        }
+    }
+
+    for (i = 0; i < m; i++) {
+        const TLDHost *h = keep[i];
+        const char *name = h->host + h->hostlen - h->tldlen;
+        long size = tld->size;
+        TLDNode *node = NULL;
+
+        if (tld->backend == TLDLIST_HASH) {
+            // A slot fetched last time round has arrived by now: fetch its node
+            // and name in turn, and the slot for the key after that
+            if (i + PREFETCH_AHEAD < m && known[i + PREFETCH_AHEAD] < 0) {
+                __builtin_prefetch(&tld->slots[hashes[i + PREFETCH_AHEAD] & (tld->capacity - 1)]);
+            }
+            if (i + PREFETCH_AHEAD / 2 < m && known[i + PREFETCH_AHEAD / 2] < 0) {
+                TLDNode *ahead = tld->slots[hashes[i + PREFETCH_AHEAD / 2] & (tld->capacity - 1)].node;
+                if (ahead != NULL) {
+                    __builtin_prefetch(ahead);
+                    __builtin_prefetch(ahead->tld);
+                }
+            }
+        }
+        // A known TLD the list has seen goes straight to its node; a tree descent
+        // depends on every comparison above it, so there is nothing to fetch
+        // ahead, and the first sight of a known TLD is rare enough not to
+        if (known[i] >= 0) {
+            node = tldlist_known(tld, known[i], 1);
+        }
+        if (node == NULL && known[i] < 0 && tld->backend == TLDLIST_HASH) {
+            node = tldhash_insert_hashed(tld, name, h->tldlen, hashes[i], 1);
+            if (node != NULL) { tld->total++; }
+        } else if (node == NULL) {
+            node = tldlist_insert(tld, name, h->tldlen, 1);
+        }
+        if (node == NULL) {
+            continue;
+        }
+        STATS_ADD(STATS_NEW_KEYS, tld->size - size);
+        tldlist_bucket(tld, node, h->date, 1);
+        counted += tldlist_host(tld, node, h->host, h->hostlen);
+    }
+    return counted;
+}
+
+int tldlist_add_count(TLDList *tld, const char *tldname, size_t len, uint32_t date, long count) {
+    return tldlist_count_node(tld, tldname, len, date, count) != NULL;
+}
+
+// tldlist_add_count, returning the node counted against, NULL if none was
+TLDNode *tldlist_count_node(TLDList *tld, const char *tldname, size_t len, uint32_t date, long count) {
+
+    // Same checks as tldlist_add, but the TLD has already been split off for us
+    // and the date range check is just two integer compares
+    if (tldname == NULL || tld == NULL || count < 1) { 
+        return NULL; 
+    }
+    if (date < tld->first_day || date > tld->last_day) { 
+        STATS_ADD(STATS_OUT_OF_RANGE, count);
+        return NULL; 
+    }
+    long size = tld->size;
+    TLDNode *node = tldlist_insert(tld, tldname, len, count);
+    if (node == NULL) {
+        return NULL;
     }
+    STATS_ADD(STATS_NEW_KEYS, tld->size - size);
+    tldlist_bucket(tld, node, date, count);
+    return node;
+}
+
+// Bucketed lists also count the entries against their day; the window check
+// compares packed dates, so a day that is not one of the window's, which an
+// impossible date given as begin or end can make, is left out of the buckets
+void tldlist_bucket(TLDList *tld, TLDNode *node, uint32_t date, long count) {
+    if (tld->ndays > 0) {
+        long day = date_days(date) - tld->day0;
+        if (day < 0 || day >= tld->ndays) { return; }
+        node->days[day] += count;
+        tld->days[day] += count;
+        tld->stale = 1;
+    }
+}
+
+// Adds the hostname just counted against `node' to its sketch, the trie
+// and the host table, if the list keeps them; returns 0 if the trie or the
+// table failed
+int tldlist_host(TLDList *tld, TLDNode *node, const char *host, size_t hostlen) {
+    if (node->sketch != NULL) {
+        hll_add(node->sketch, hll_hash(host, hostlen));
+    }
+    // Only entries inside the window reach the trie, so its root agrees with tldlist_count
+    if (tld->trie != NULL && !labeltrie_add(tld->trie, host, hostlen, 1)) {
+        return 0;
+    }
+    if (tld->hosts != NULL && !hosttable_add(tld->hosts, host, hostlen, 1)) {
+        return 0;
+    }
+    return 1;
+}
+
+int tldlist_add_sketch(TLDList *tld, const char *tldname, size_t len, const uint8_t *registers) {
+    if (tld->sketches == NULL) {
+        return 0;
+    }
+    // A count of nothing finds the node without changing it
+    TLDNode *node = tldlist_insert(tld, tldname, len, 0);
+    if (node == NULL) {
+        return 0;
+    }
+    hll_merge(node->sketch, registers);
+    return 1;
+}
+
+void tldlist_window(TLDList *tld, uint32_t *begin, uint32_t *end) {
+    *begin = tld->first_day;
+    *end = tld->last_day;
+}
+
+int tldlist_merge(TLDList *dst, TLDList *src) {
+    // Walk src in the order its TLDs were first seen, so dst grows exactly as
+    // it would have if it had been fed src's log lines directly
+    TLDNode *node = NULL;
+    long shift = src->day0 - dst->day0;
+    for (node = src->first; node != NULL; node = node->next) {
+        TLDNode *into = tldlist_insert(dst, node->tld, strlen(node->tld), node->count);
+        if (into == NULL) {
+            return 0;
+        }
+        if (into->sketch != NULL && node->sketch != NULL) {
+            hll_merge(into->sketch, node->sketch);
+        }
+        // Day buckets line up by day number, anything outside dst's window is dropped
+        if (dst->ndays > 0 && src->ndays > 0) {
+            for (long day = 0; day < src->ndays; day++) {
+                if (day + shift >= 0 && day + shift < dst->ndays) { into->days[day + shift] += node->days[day]; }
+            }
+        }
+    }
+    if (dst->ndays > 0 && src->ndays > 0) {
+        for (long day = 0; day < src->ndays; day++) {
+            if (day + shift >= 0 && day + shift < dst->ndays) { dst->days[day + shift] += src->days[day]; }
+        }
+        dst->stale = 1;
+    }
+    if (dst->hosts != NULL && src->hosts != NULL && !hosttable_merge(dst->hosts, src->hosts)) {
+        return 0;
+    }
+    if (dst->trie != NULL && src->trie != NULL) {
+        return labeltrie_merge(dst->trie, src->trie);
+    }
+    return 1;
+}
+
+TLDNode *tldlist_find(TLDList *tld, const char *name, size_t len) {
+    long index = tldtable_find(name, len);
+    TLDNode *node;
+
+    if (index >= 0) {
+        return tld->known_nodes[index];
+    }
+    if (tld->backend == TLDLIST_HASH) {
+        unsigned long hash = tldhash(name, len), mask = tld->capacity - 1;
+        for (unsigned long i = hash & mask; tld->slots[i].node != NULL; i = (i + 1) & mask) {
+            if (tld->slots[i].hash == hash && strcompare(name, len, tld->slots[i].node->tld) == 0) {
+                return tld->slots[i].node;
+            }
+        }
+        return NULL;
+    }
+    for (node = tld->root; node != NULL; ) {
+        int diff = strcompare(name, len, node->tld);
+        if (diff == 0) { return node; }
+        node = (diff < 0) ? node->left : node->right;
+    }
+    return NULL;
+}
+
+TLDNode *tldlist_insert(TLDList *tld, const char *name, size_t len, long count) {
+    // Known TLDs only go through the tree or table the first time they're seen
+    long index = tldtable_find(name, len);
+    TLDNode *node = (index >= 0) ? tldlist_known(tld, index, count) : NULL;
+    if (node != NULL) {
+        return node;
+    }
+    node = (tld->backend == TLDLIST_HASH) ? tldhash_insert(tld, name, len, count)
+                                          : tldtree_insert(tld, name, len, count);
+    // Keep the total up to date here so tldlist_count never has to walk the list
+    if (node != NULL) {
+        tld->total += count;
+        if (index >= 0) { tld->known_nodes[index] = node; }
+    }
+    return node;
+}
+
+// Counts a known TLD against the node the array holds for it, returning the
+// node, NULL if the list has yet to see it; in the tree, the count goes up
+// the parent links into the subtree sums, as a descent would have added it
+TLDNode *tldlist_known(TLDList *tld, long index, long count) {
+    TLDNode *node = tld->known_nodes[index];
+    if (node != NULL) {
+        node->count += count;
+        tld->total += count;
+        if (tld->backend == TLDLIST_AVL) {
+            for (TLDNode *up = node; up != NULL; up = up->parent) { up->sum += count; }
+        }
+    }
+    return node;
+}
+
+TLDNode *tldtree_insert(TLDList *tld, const char *name, size_t len, long count) {
+
+    // Local Variable to keep track of successful addition
+    short int success = -1;
 
     // Base Case: The List has no node for the root
     if (tld->root == NULL) {
-        tld->root = tldnode_create(hostname, NULL);
-        success = (tld->root == NULL) ? 0 : 1;
-        return success;         // If unsuccessful, return 0, else 1
+        tld->root = tldnode_create(tld, name, len, NULL);
+        if (tld->root == NULL) { return NULL; }
+        tld->root->count = count;
+        tld->root->sum = count;
+        tldlist_append(tld, tld->root);
+        return tld->root;
     } 
-    // If the list does have a root, search the tree for hostname and add it
+    // If the list does have a root, search the tree for the TLD and add it
     TLDNode *node = NULL;
     node = tld->root;
+    long depth = 0;
     while (success == -1) {
        
-        // So we need the domain's TLD so we'll strip it and compare it to the current node's TLD
-        char *temp = NULL;
-        temp  = tldstrip(hostname);
-        if (temp == NULL) { success=0; break; }
-        int tld_diff = strcompare(temp, node->tld);  
-        free(temp);
-
-        // If current node's TLD is equal to the one we're searching for then add one to count
+        depth++;
+        int tld_diff = strcompare(name, len, node->tld);  
+
+        // Whatever happens below, the count ends up in this node's subtree
+        node->sum += count;
+
+        // If current node's TLD is equal to the one we're searching for then add to its count
         if (tld_diff == 0) {
-            node->count += 1;
+            node->count += count;
             success = 1;
         }
         // Else we need to see if the tld is of greater or less value to the children of the current node
@@ -158,36 +568,140 @@ int tldlist_add(TLDList *tld, char *hostname, Date *d) {
             // If the leaf we are looking at is null then create a new node
             // If we don't enter this, we continue down the tree
             if (node == NULL) {
+                node = tldnode_create(tld, name, len, parent);
+                if (node == NULL) {
+                    // Take back the count we added to the subtree sums on the way down
+                    for (node = parent; node != NULL; node = node->parent) { node->sum -= count; }
+                    success = 0;
+                    break;
+                }
+                node->count = count;
+                node->sum = count;
                 if (goLeft) {
-                    parent->left = tldnode_create(hostname, parent);
-                    success = (parent->left == NULL ? 0 : 1);
+                    parent->left = node;
                 } else {
-                    parent->right = tldnode_create(hostname, parent);
-                    success = (parent->right == NULL ? 0 : 1);
+                    parent->right = node;
                 }
-                // If we successfully added a node, rebalance the parent just incase the balance is off
-                if (success > 0) { rebalance(parent, tld); };
+                tldlist_append(tld, node);
+                success = 1;
+                STATS_MAX(STATS_MAX_DEPTH, depth + 1);
+                // We successfully added a node, rebalance the parent just incase the balance is off
+                rebalance(parent, tld);
             }
         }
     }
-    return success;
+    return (success == 1) ? node : NULL;
+}
+
+void tldlist_append(TLDList *tld, TLDNode *node) {
+    // Remember the order TLDs were first seen in, tldlist_merge() replays it
+    if (tld->last == NULL) {
+        tld->first = node;
+    } else {
+        tld->last->next = node;
+    }
+    tld->last = node;
+    tld->size++;
 }
 
 
 long tldlist_count(TLDList *tld) {
-    // Ensure passed tld is not null before turning a the number of sucessful additions
-    long tally = 0;
-    tldlist_inorder_count(tld->root, &tally);
-    return tally;
+    // The total is kept as entries are added, so this is O(1)
+    return tld->total;
 }
 
-void tldlist_inorder_count(TLDNode *node, long *tally) {
-    if (node == NULL) {
-        return ;
+long tldlist_size(TLDList *tld) {
+    return tld->size;
+}
+
+long tldlist_count_below(TLDList *tld, const char *name) {
+    // Walk down towards `name', picking up everything that sorts before it
+    if (tld->backend != TLDLIST_AVL) { return -1; }
+    size_t len = strlen(name);
+    long below = 0;
+    TLDNode *node = tld->root;
+    while (node != NULL) {
+        int tld_diff = strcompare(name, len, node->tld);
+        if (tld_diff <= 0) {
+            if (tld_diff == 0) { return below + subtree_sum(node->left); }
+            node = node->left;
+        } else {
+            below += subtree_sum(node->left) + node->count;
+            node = node->right;
+        }
     }
-    tldlist_inorder_count(node->left, tally);
-    *tally += tldnode_count(node);
-    tldlist_inorder_count(node->right, tally);
+    return below;
+}
+
+TLDNode *tldlist_select(TLDList *tld, long k) {
+    // Find the node whose events cover position `k' in name order
+    if (tld->backend != TLDLIST_AVL || k < 1 || k > tld->total) { return NULL; }
+    TLDNode *node = tld->root;
+    while (node != NULL) {
+        long left = subtree_sum(node->left);
+        if (k <= left) {
+            node = node->left;
+        } else if (k <= left + node->count) {
+            return node;
+        } else {
+            k -= left + node->count;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+/*
+/
+/ Day Bucket Implementation
+/
+*/
+
+long tldlist_count_range(TLDList *tld, uint32_t begin, uint32_t end) {
+    if (tld->ndays == 0 || !tldlist_prefix(tld)) { return -1; }
+    return prefix_range(tld, tld->prefix, begin, end);
+}
+
+long tldnode_count_range(TLDList *tld, TLDNode *node, uint32_t begin, uint32_t end) {
+    if (tld->ndays == 0 || !tldlist_prefix(tld)) { return -1; }
+    return prefix_range(tld, node->prefix, begin, end);
+}
+
+int tldlist_prefix(TLDList *tld) {
+    // Rebuild the prefix sums in one pass after any adds, so a batch of
+    // range queries costs O(1) per TLD each; the list stays stale until
+    // every node has its sums, so a failed rebuild is tried again
+    if (tld->ndays == 0 || !tld->stale) { return 1; }
+    for (TLDNode *node = tld->first; node != NULL; node = node->next) {
+        if (node->prefix == NULL) {
+            node->prefix = (long *) arena_alloc(tld->buckets, (tld->ndays + 1) * sizeof(long), _Alignof(long));
+            if (node->prefix == NULL) { return 0; }
+        } else if (node->prefix[tld->ndays] == node->count) {
+            // Counts only grow, and never by less than the days do, so a
+            // node whose count still matches its sums has the same days
+            continue;
+        }
+        node->prefix[0] = 0;
+        for (long day = 0; day < tld->ndays; day++) {
+            node->prefix[day + 1] = node->prefix[day] + node->days[day];
+        }
+    }
+    tld->prefix[0] = 0;
+    for (long day = 0; day < tld->ndays; day++) {
+        tld->prefix[day + 1] = tld->prefix[day] + tld->days[day];
+    }
+    tld->stale = 0;
+    return 1;
+}
+
+long prefix_range(TLDList *tld, long *prefix, uint32_t begin, uint32_t end) {
+    // Clip begin..end to the window, zero if nothing is left or the sums are unbuilt
+    long lo = date_days(begin) - tld->day0, hi = date_days(end) - tld->day0;
+    if (prefix == NULL || lo >= tld->ndays || hi < 0) { return 0; }
+    if (lo < 0) { lo = 0; }
+    if (hi >= tld->ndays) { hi = tld->ndays - 1; }
+    if (lo > hi) { return 0; }
+    return prefix[hi + 1] - prefix[lo];
 }
 
 /*
@@ -206,6 +720,16 @@ void reheight(TLDNode *node) {
     }
 } 
 
+void resum(TLDNode *node) {
+    if (node != NULL) {
+        node->sum = node->count + subtree_sum(node->left) + subtree_sum(node->right);
+    }
+}
+
+long subtree_sum(TLDNode *node) {
+    return (node == NULL) ? 0 : node->sum;
+}
+
 int height(TLDNode *node) {
     if (node == NULL) {
         return -1; 
@@ -249,6 +773,7 @@ void rebalance(TLDNode *node, TLDList *list) {
 }
 
 TLDNode *left_rotate(TLDNode *grandparent) {
+    STATS_ADD(STATS_ROTATIONS, 1);
     // If we do a left rotate, the parent of the new node, is the granparent's right node
     TLDNode *parent = grandparent->right;
 
@@ -274,15 +799,18 @@ TLDNode *left_rotate(TLDNode *grandparent) {
         }
     }
 
-    // Because we have shifted nodes around, we'll need to check their heights and balance
+    // Because we have shifted nodes around, we'll need to check their heights, balance and sums
     setbalance(grandparent);
     setbalance(parent);
+    resum(grandparent);
+    resum(parent);
 
     // Return the parent as a node, we'll need this to check if it's a root or not
     return parent;
 }
 
 TLDNode *right_rotate(TLDNode *grandparent) {
+    STATS_ADD(STATS_ROTATIONS, 1);
     // If we do a right rotate, the parent of the new node, is the granparent's left node
     TLDNode *parent = grandparent->left;
 
@@ -308,9 +836,11 @@ TLDNode *right_rotate(TLDNode *grandparent) {
         }
     }
 
-    // Because we have shifted nodes around, we'll need to check their heights and balance
+    // Because we have shifted nodes around, we'll need to check their heights, balance and sums
     setbalance(grandparent);
     setbalance(parent);
+    resum(grandparent);
+    resum(parent);
 
     // Return the parent as a node, we'll need this to check if it's a root or not
     return parent;
@@ -329,6 +859,75 @@ TLDNode *right_left_rotate(TLDNode *grandparent) {
     // Rotate grandparent
     return left_rotate(grandparent);
 }
+/*
+/
+/ Hash Table Implementation
+/
+*/
+
+TLDNode *tldhash_insert(TLDList *tld, const char *name, size_t len, long count) {
+    return tldhash_insert_hashed(tld, name, len, tldhash(name, len), count);
+}
+
+TLDNode *tldhash_insert_hashed(TLDList *tld, const char *name, size_t len, unsigned long hash, long count) {
+    // Open addressing with linear probing, the full hash is kept in the slot
+    // so that only a genuine match has to compare strings
+    unsigned long mask = tld->capacity - 1;
+    unsigned long i = hash & mask;
+
+    while (tld->slots[i].node != NULL) {
+        if (tld->slots[i].hash == hash && strcompare(name, len, tld->slots[i].node->tld) == 0) {
+            tld->slots[i].node->count += count;
+            return tld->slots[i].node;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // First time we've seen this TLD, keep the load factor under a half
+    if (2 * (tld->used + 1) > tld->capacity) {
+        if (!tldhash_grow(tld)) { return NULL; }
+        mask = tld->capacity - 1;
+        for (i = hash & mask; tld->slots[i].node != NULL; i = (i + 1) & mask) {}
+    }
+    TLDNode *node = tldnode_create(tld, name, len, NULL);
+    if (node == NULL) { return NULL; }
+    node->count = count;
+    tld->slots[i].hash = hash;
+    tld->slots[i].node = node;
+    tld->used++;
+    tldlist_append(tld, node);
+    return node;
+}
+
+int tldhash_grow(TLDList *tld) {
+    // Double the table and re-place every node using its stored hash
+    unsigned long capacity = tld->capacity * 2;
+    unsigned long mask = capacity - 1;
+    struct tldslot *slots = (struct tldslot *) mem_calloc(capacity, sizeof(struct tldslot));
+    if (slots == NULL) { return 0; }
+    for (unsigned long j = 0; j < tld->capacity; j++) {
+        if (tld->slots[j].node != NULL) {
+            unsigned long i = tld->slots[j].hash & mask;
+            while (slots[i].node != NULL) { i = (i + 1) & mask; }
+            slots[i] = tld->slots[j];
+        }
+    }
+    mem_free(tld->slots);
+    tld->slots = slots;
+    tld->capacity = capacity;
+    return 1;
+}
+
+// FNV-1a over the lower-cased key, so that hashing agrees with strcompare
+unsigned long tldhash(const char *s, size_t len) {
+    unsigned long hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= LOGLINE_FOLD(s[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
 /*
 /
 / TLDIterator Implementation
@@ -338,7 +937,7 @@ TLDNode *right_left_rotate(TLDNode *grandparent) {
 TLDIterator *tldlist_iter_create(TLDList *tld) {
     
     // Assign space for new iterator and it's members in the heap
-    TLDIterator *iter = (TLDIterator *) malloc(sizeof(TLDIterator));
+    TLDIterator *iter = (TLDIterator *) mem_malloc(sizeof(TLDIterator));
 
     // If malloc fails then return null
     if (iter == NULL) { return NULL; }
@@ -346,8 +945,9 @@ TLDIterator *tldlist_iter_create(TLDList *tld) {
     // Get root
     TLDNode *root = tld->root;
 
-    // Assign members to iterator
-    iter->pointer = root;
+    // Assign members to iterator, the hash table is walked in insertion order
+    iter->backend = tld->backend;
+    iter->pointer = (tld->backend == TLDLIST_HASH) ? tld->first : root;
 
     return iter;
 }
@@ -359,6 +959,10 @@ TLDNode *tldlist_iter_next(TLDIterator *iter) {
 
     // Ok, so we'll need to cover our bases
     if (iter->pointer == NULL) { return NULL; }
+    if (iter->backend == TLDLIST_HASH) {
+        iter->pointer = iter->pointer->next;
+        return old_ptr;
+    }
 
     // If we have the root of the tree and no children, return root, now point to null
     if (iter->pointer->left == NULL && iter->pointer->right == NULL && iter->pointer->parent == NULL) {
@@ -391,8 +995,98 @@ TLDNode *tldlist_iter_next(TLDIterator *iter) {
     return old_ptr;
 }
 
+long tldlist_iter_next_batch(TLDIterator *iter, TLDEntry *out, long n) {
+    TLDNode *node;
+    long i;
+    for (i = 0; i < n && (node = tldlist_iter_next(iter)) != NULL; i++) {
+        out[i].name     = node->tld;
+        out[i].count    = node->count;
+        out[i].distinct = tldnode_distinct(node);
+    }
+    return i;
+}
+
 void tldlist_iter_destroy(TLDIterator *iter) {
-    free(iter);
+    mem_free(iter);
+}
+
+/*
+/
+/ Snapshot Implementation
+/
+*/
+
+TLDSnapshot *tldlist_snapshot(TLDList *tld, enum tldlist_order order) {
+    TLDNode *node;
+    size_t names = 0;
+    long i = 0;
+
+    // One allocation for the lot: header, entries, then the names they point at
+    for (node = tld->first; node != NULL; node = node->next) {
+        names += strlen(node->tld) + 1;
+    }
+    TLDSnapshot *snap = (TLDSnapshot *) mem_malloc(sizeof(TLDSnapshot) + tld->size * sizeof(TLDEntry) + names);
+    if (snap == NULL) { return NULL; }
+    snap->size    = tld->size;
+    snap->total   = tld->total;
+    snap->entries = (TLDEntry *) (snap + 1);
+    char *pool = (char *) (snap->entries + tld->size);
+
+    // Unsorted has to match the iterator, any other order can take the insertion chain
+    if (order == TLDLIST_UNSORTED) {
+        TLDIterator iter = { (tld->backend == TLDLIST_HASH) ? tld->first : tld->root, tld->backend };
+        while ((node = tldlist_iter_next(&iter)) != NULL) {
+            pool = snapshot_entry(&snap->entries[i++], node, pool);
+        }
+    } else {
+        for (node = tld->first; node != NULL; node = node->next) {
+            pool = snapshot_entry(&snap->entries[i++], node, pool);
+        }
+    }
+    if (order != TLDLIST_UNSORTED) {
+        qsort(snap->entries, snap->size, sizeof(TLDEntry), (order == TLDLIST_BY_NAME) ? tldentry_by_name : tldentry_by_count);
+    }
+    return snap;
+}
+
+// Copies `node' into `entry', its name into `pool', and returns the pool's next free byte
+char *snapshot_entry(TLDEntry *entry, TLDNode *node, char *pool) {
+    size_t len = strlen(node->tld) + 1;
+    memcpy(pool, node->tld, len);
+    entry->name     = pool;
+    entry->count    = node->count;
+    entry->distinct = tldnode_distinct(node);
+    return pool + len;
+}
+
+TLDEntry *tldsnapshot_entries(TLDSnapshot *snap) {
+    return snap->entries;
+}
+
+long tldsnapshot_size(TLDSnapshot *snap) {
+    return snap->size;
+}
+
+long tldsnapshot_count(TLDSnapshot *snap) {
+    return snap->total;
+}
+
+void tldsnapshot_destroy(TLDSnapshot *snap) {
+    mem_free(snap);
+}
+
+int tldentry_by_count(const void *a, const void *b) {
+    const TLDEntry *e1 = a, *e2 = b;
+    if (e1->count != e2->count) {
+        return (e1->count < e2->count) ? -1 : 1;
+    }
+    return strcmp(e1->name, e2->name);
+}
+
+int tldentry_by_name(const void *a, const void *b) {
+    const TLDEntry *e1 = a, *e2 = b;
+    int diff = strcasecmp(e1->name, e2->name);
+    return (diff != 0) ? diff : strcmp(e1->name, e2->name);
 }
 
 /*
@@ -401,29 +1095,52 @@ void tldlist_iter_destroy(TLDIterator *iter) {
 /
 */
 
-TLDNode *tldnode_create(char *tld, TLDNode *parent) {
+TLDNode *tldnode_create(TLDList *list, const char *tld, size_t len, TLDNode *parent) {
     
-    // Assign space for new node in the heap
+    // Take the next node from the list's slab, and its name from the string pool
     TLDNode *node = NULL;
-    node = (TLDNode *) malloc(sizeof(TLDNode));
+    node = (TLDNode *) arena_alloc(list->nodes, sizeof(TLDNode), _Alignof(TLDNode));
     if (node == NULL) { 
         return NULL; 
     }
     char *domain = NULL;
-    domain = tldstrip(tld);
+    domain = arena_strndup(list->names, tld, len);
     if (domain == NULL) { 
-        free(node); return NULL;
+        return NULL;
     }
 
 
     // Assign members to the new node
     node->parent  = parent;
+    node->next    = NULL;
     node->left    = NULL;
     node->right   = NULL;
     node->count   = 1;
+    node->sum     = 1;
     node->tld     = domain;
     node->height  = 0;
     node->balance = 0;
+    node->days    = NULL;
+    node->prefix  = NULL;
+    node->sketch  = NULL;
+
+    // Bucketed lists give every node a zeroed bucket per day
+    if (list->ndays > 0) {
+        node->days = (long *) arena_alloc(list->buckets, list->ndays * sizeof(long), _Alignof(long));
+        if (node->days == NULL) {
+            return NULL;
+        }
+        memset(node->days, 0, list->ndays * sizeof(long));
+    }
+
+    // And lists with sketches give it empty registers
+    if (list->sketches != NULL) {
+        node->sketch = (uint8_t *) arena_alloc(list->sketches, HLL_REGISTERS, 1);
+        if (node->sketch == NULL) {
+            return NULL;
+        }
+        memset(node->sketch, 0, HLL_REGISTERS);
+    }
     return node;
 }
 
@@ -436,50 +1153,30 @@ long tldnode_count(TLDNode *node) {
     return node->count;
 }
 
+const uint8_t *tldnode_sketch(TLDNode *node) {
+    return node->sketch;
+}
 
-void tldnode_destory(TLDNode *node) {
-    // Don't forget to free duplicated string and node 
-    // The children will be free in a parent call of tld_destory_recurrisive
-    // Do not use this function by itself, make sure to call ^
-    free(node->tld);
-    free(node);
+long tldnode_distinct(TLDNode *node) {
+    return (node->sketch == NULL) ? -1 : hll_estimate(node->sketch);
 }
 
+
 /*
 /
 / String Implementations
 /
 */
 
-// Given an input domain, stip it down and return the TLD
-char *tldstrip(char *str) {
-    if (str == NULL) { return NULL; }
-    char *p = NULL;
-    p = strdup(str);
-    if (p == NULL) { return NULL; }
-    char *p_start = NULL;
-    p_start = p;
-    char *tld = NULL;
-    tld = p;
-    while(*p != '\0') {
-        if (*p == '.') {
-            tld = ++p;
+// Had to implement as Standard library strcasecmp was causing a bug
+// Compares the `n1' bytes at `s1' (which need not be terminated) against `s2'
+int strcompare(const char *s1, size_t n1, const char *s2) {
+    for (size_t i = 0; i < n1; i++) {
+        int c1 = LOGLINE_FOLD(s1[i]);
+        int c2 = LOGLINE_FOLD(s2[i]);
+        if (c1 != c2) {
+            return c1 - c2;
         }
-        p++;
     }
-    char *stripped = NULL;
-    stripped = (char *) malloc(sizeof(char) * ((p+1)-tld));
-    if (stripped != NULL) {
-        for (int i=0; (stripped[i] = tld[i]) != '\0'; i++) {}
-    }
-    free(p_start);
-    return stripped;
+    return -LOGLINE_FOLD(s2[n1]);
 }
-
-// Had to implement as Standard library strcasecmp was causing a bug
-int strcompare(const char *s1, const char *s2) {
-    while (tolower(*s1) == tolower(*s2++))
-	    if (*s1++ == '\0')
-			return 0;
-	return (tolower(*(unsigned char *)s1) - tolower(*(unsigned char *)--s2));
-}
\ No newline at end of file
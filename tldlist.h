@@ -1,11 +1,59 @@
 #ifndef _TLDLIST_H_INCLUDED_
 #define _TLDLIST_H_INCLUDED_
 
+#include <stddef.h>
+#include <stdint.h>
 #include "date.h"
+#include "hosttable.h"
+#include "labeltrie.h"
 
 typedef struct tldlist TLDList;
 typedef struct tldnode TLDNode;
 typedef struct tlditerator TLDIterator;
+typedef struct tldentry TLDEntry;
+typedef struct tldsnapshot TLDSnapshot;
+typedef struct tldhost TLDHost;
+
+/*
+ * one TLD and its count, as copied out of a list by tldlist_snapshot() or
+ * tldlist_iter_next_batch(); `distinct' is the estimated number of
+ * distinct hostnames, -1 unless the list keeps sketches
+ */
+struct tldentry {
+    const char *name;
+    long count;
+    long distinct;
+};
+
+/*
+ * one log entry for tldlist_add_batch(): the `hostlen' bytes at `host',
+ * which need not be NUL-terminated, whose TLD is the last `tldlen' of
+ * them, dated `date' (packed by date_pack() or date_parse_packed())
+ */
+struct tldhost {
+    const char *host;
+    uint32_t hostlen;
+    uint32_t tldlen;
+    uint32_t date;
+};
+
+/*
+ * the orders a snapshot can be taken in: the order of the list's
+ * iterator, by ascending count (ties by name, as `sort -n' would order
+ * report lines), or by name without regard to case
+ */
+enum tldlist_order { TLDLIST_UNSORTED, TLDLIST_BY_COUNT, TLDLIST_BY_NAME };
+
+/*
+ * the structures that can back a TLDList: a balanced binary tree, or an
+ * open-addressing hash table of case-folded keys; tldlist_create() uses
+ * TLDLIST_DEFAULT_BACKEND, which can be set at build time
+ */
+enum tldlist_backend { TLDLIST_AVL, TLDLIST_HASH };
+
+#ifndef TLDLIST_DEFAULT_BACKEND
+#define TLDLIST_DEFAULT_BACKEND TLDLIST_AVL
+#endif
 
 /*
  * tldlist_create generates a list structure for storing counts against
@@ -16,6 +64,65 @@ typedef struct tlditerator TLDIterator;
  */
 TLDList *tldlist_create(Date *begin, Date *end);
 
+/*
+ * tldlist_create_backend is tldlist_create() with an explicit `backend';
+ * iteration order is that of the tree for TLDLIST_AVL, and the order TLDs
+ * were first added for TLDLIST_HASH
+ */
+TLDList *tldlist_create_backend(Date *begin, Date *end, enum tldlist_backend backend);
+
+/*
+ * tldlist_create_bucketed is tldlist_create_backend() for a list that also
+ * keeps a count per TLD per day of the `begin'..`end' window, so that one
+ * pass over the logs can answer tldlist_count_range() and
+ * tldnode_count_range() for any number of sub-ranges
+ * returns a pointer to the list if successful, NULL if not
+ */
+TLDList *tldlist_create_bucketed(Date *begin, Date *end, enum tldlist_backend backend);
+
+/*
+ * tldlist_set_depth makes `tld' also count each hostname added through
+ * tldlist_add_host() against its domain suffixes, down to `depth' labels,
+ * in a LabelTrie; it must be called before anything is added
+ * returns 1 if successful, 0 if not
+ */
+int tldlist_set_depth(TLDList *tld, int depth);
+
+/*
+ * tldlist_set_distinct makes `tld' keep a HyperLogLog sketch (see hll.h)
+ * of the hostnames added to each TLD through tldlist_add_host(), in a
+ * fixed HLL_REGISTERS bytes per TLD; it must be called before anything is
+ * added
+ * returns 1 if successful, 0 if not
+ */
+int tldlist_set_distinct(TLDList *tld);
+
+/*
+ * tldlist_has_sketches returns 1 if `tld' keeps sketches, 0 if not
+ */
+int tldlist_has_sketches(TLDList *tld);
+
+/*
+ * tldlist_set_hosts makes `tld' also count every hostname added through
+ * tldlist_add_host() in full, in a HostTable that keeps within `max_mem'
+ * bytes (0 for no limit) by spilling to temporary files; it must be called
+ * before anything is added
+ * returns 1 if successful, 0 if not
+ */
+int tldlist_set_hosts(TLDList *tld, size_t max_mem);
+
+/*
+ * tldlist_hosts returns the HostTable of a list given one by
+ * tldlist_set_hosts(), NULL for any other list
+ */
+HostTable *tldlist_hosts(TLDList *tld);
+
+/*
+ * tldlist_trie returns the LabelTrie of a list given a depth by
+ * tldlist_set_depth(), NULL for any other list
+ */
+LabelTrie *tldlist_trie(TLDList *tld);
+
 /*
  * tldlist_destroy destroys the list structure in `tld'
  *
@@ -30,12 +137,129 @@ void tldlist_destroy(TLDList *tld);
  */
 int tldlist_add(TLDList *tld, char *hostname, Date *d);
 
+/*
+ * tldlist_add_tld is tldlist_add() for a TLD already split off its hostname:
+ * only the `len' bytes at `tldname' are read, they need not be
+ * NUL-terminated, and they are copied only when the TLD is new to the list
+ * returns 1 if the entry was counted, 0 if not
+ */
+int tldlist_add_tld(TLDList *tld, const char *tldname, size_t len, Date *d);
+
+/*
+ * tldlist_add_packed is tldlist_add_tld() for a date already packed by
+ * date_pack() or date_parse_packed()
+ * returns 1 if the entry was counted, 0 if not
+ */
+int tldlist_add_packed(TLDList *tld, const char *tldname, size_t len, uint32_t date);
+
+/*
+ * tldlist_add_host is tldlist_add_packed() for the `hostlen' bytes of
+ * `host', whose TLD is its last `tldlen' bytes; an entry that is counted
+ * is also counted in the list's LabelTrie and the TLD's sketch, if the
+ * list has them
+ * returns 1 if the entry was counted, 0 if not
+ */
+int tldlist_add_host(TLDList *tld, const char *host, size_t hostlen, size_t tldlen, uint32_t date);
+
+/*
+ * tldlist_add_batch is tldlist_add_host() for the `n' entries at `hosts',
+ * counted in order, so the list ends up exactly as it would one add at a
+ * time; a block of entries is filtered on its dates and then hashed in
+ * one pass, and each hash table lookup is overlapped with fetching the
+ * slots and keys of the ones after it
+ * returns the number of entries counted
+ */
+long tldlist_add_batch(TLDList *tld, const TLDHost *hosts, size_t n);
+
+/*
+ * tldlist_add_count is tldlist_add_packed() for `count' entries of the same
+ * TLD on the same day, as when a saved list is read back
+ * returns 1 if the entries were counted, 0 if not
+ */
+int tldlist_add_count(TLDList *tld, const char *tldname, size_t len, uint32_t date, long count);
+
+/*
+ * tldlist_add_sketch merges the sketch `registers' into that of the TLD
+ * `tldname' (`len' bytes, as for tldlist_add_tld), as when a saved list is
+ * read back; the TLD must already have been counted
+ * returns 1 if successful, 0 if not (the list keeps no sketches, or memory
+ * allocation failure)
+ */
+int tldlist_add_sketch(TLDList *tld, const char *tldname, size_t len, const uint8_t *registers);
+
+/*
+ * tldlist_window stores the list's begin and end dates, packed, in `begin'
+ * and `end'
+ */
+void tldlist_window(TLDList *tld, uint32_t *begin, uint32_t *end);
+
+/*
+ * tldlist_merge adds every TLD count held in `src' to `dst', in the order
+ * the TLDs were first added to `src', along with its LabelTrie and
+ * sketches if both lists have them; `src' is left unchanged and is not date-checked again,
+ * except that its HostTable, if both lists have one, is emptied into `dst'
+ * returns 1 if successful, 0 if not (memory allocation failure)
+ */
+int tldlist_merge(TLDList *dst, TLDList *src);
+
 /*
  * tldlist_count returns the number of successful tldlist_add() calls since
- * the creation of the TLDList
+ * the creation of the TLDList; the total is kept as entries are added, so
+ * this is O(1)
  */
 long tldlist_count(TLDList *tld);
 
+/*
+ * tldlist_size returns the number of distinct TLDs held in the list
+ */
+long tldlist_size(TLDList *tld);
+
+/*
+ * tldlist_find returns the TLDNode of the TLD in the `len' bytes at `name'
+ * (case-insensitively), without adding it
+ * returns NULL if the list has not counted that TLD
+ */
+TLDNode *tldlist_find(TLDList *tld, const char *name, size_t len);
+
+/*
+ * tldlist_count_below returns the number of counted entries whose TLD sorts
+ * before `name' (case-insensitively), in O(log n)
+ * returns -1 if the list is not a TLDLIST_AVL list, which keeps no order
+ */
+long tldlist_count_below(TLDList *tld, const char *name);
+
+/*
+ * tldlist_select returns the TLDNode holding the `k'th counted entry, with
+ * entries numbered from 1 in TLD name order, in O(log n)
+ * returns NULL if `k' is out of range or the list is not a TLDLIST_AVL list
+ */
+TLDNode *tldlist_select(TLDList *tld, long k);
+
+/*
+ * tldlist_count_range returns the number of entries counted with a date in
+ * `begin'..`end' (packed, inclusive, clipped to the list's window); the
+ * first query after any add rebuilds the prefix sums of the TLDs added to,
+ * in O(#days) each, after which each query is O(1)
+ * returns -1 if the list was not created by tldlist_create_bucketed(), or
+ *         if its prefix sums could not be rebuilt (see tldlist_prefix())
+ */
+long tldlist_count_range(TLDList *tld, uint32_t begin, uint32_t end);
+
+/*
+ * tldnode_count_range is tldlist_count_range() for the single TLD `node'
+ * of `tld'
+ */
+long tldnode_count_range(TLDList *tld, TLDNode *node, uint32_t begin, uint32_t end);
+
+/*
+ * tldlist_prefix rebuilds the prefix sums the range queries above read,
+ * if anything was added since they were last built; it is done by the
+ * first query anyway, but calling it first tells a memory allocation
+ * failure apart from a list without day buckets
+ * returns 1 if successful (or if `tld' keeps no day buckets), 0 if not
+ */
+int tldlist_prefix(TLDList *tld);
+
 /*
  * tldlist_iter_create creates an iterator over the TLDList; returns a pointer
  * to the iterator if successful, NULL if not
@@ -48,11 +272,57 @@ TLDIterator *tldlist_iter_create(TLDList *tld);
  */
 TLDNode *tldlist_iter_next(TLDIterator *iter);
 
+/*
+ * tldlist_iter_next_batch copies the next (up to) `n' elements of the
+ * list into `out', in the order tldlist_iter_next() would return them;
+ * the names point into the list and last as long as it does
+ * returns the number of entries stored, 0 once the list is exhausted
+ */
+long tldlist_iter_next_batch(TLDIterator *iter, TLDEntry *out, long n);
+
 /*
  * tldlist_iter_destroy destroys the iterator specified by `iter'
  */
 void tldlist_iter_destroy(TLDIterator *iter);
 
+/*
+ * tldlist_snapshot copies every TLD of `tld' and its count, in `order',
+ * into one contiguous block holding the entries followed by their names;
+ * the snapshot owns its copy, so it stays valid and unchanged while the
+ * list goes on counting, and after it is destroyed
+ * returns a pointer to the snapshot if successful, NULL if not
+ */
+TLDSnapshot *tldlist_snapshot(TLDList *tld, enum tldlist_order order);
+
+/*
+ * tldsnapshot_entries returns the snapshot's array of tldsnapshot_size()
+ * entries
+ */
+TLDEntry *tldsnapshot_entries(TLDSnapshot *snap);
+
+/*
+ * tldsnapshot_size returns the number of TLDs in the snapshot
+ */
+long tldsnapshot_size(TLDSnapshot *snap);
+
+/*
+ * tldsnapshot_count returns the list's tldlist_count() when the snapshot
+ * was taken
+ */
+long tldsnapshot_count(TLDSnapshot *snap);
+
+/*
+ * tldsnapshot_destroy frees the snapshot in one call
+ */
+void tldsnapshot_destroy(TLDSnapshot *snap);
+
+/*
+ * tldentry_by_count and tldentry_by_name are qsort() comparisons of two
+ * TLDEntry, in TLDLIST_BY_COUNT and TLDLIST_BY_NAME order
+ */
+int tldentry_by_count(const void *a, const void *b);
+int tldentry_by_name(const void *a, const void *b);
+
 /*
  * tldnode_tldname returns the tld associated with the TLDNode
  */
@@ -64,4 +334,16 @@ char *tldnode_tldname(TLDNode *node);
  */
 long tldnode_count(TLDNode *node);
 
+/*
+ * tldnode_sketch returns the HLL_REGISTERS bytes of the TLD's sketch, NULL
+ * if the list keeps none
+ */
+const uint8_t *tldnode_sketch(TLDNode *node);
+
+/*
+ * tldnode_distinct returns the estimated number of distinct hostnames
+ * counted for the TLD, -1 if the list keeps no sketches
+ */
+long tldnode_distinct(TLDNode *node);
+
 #endif /* _TLDLIST_H_INCLUDED_ */
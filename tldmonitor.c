@@ -1,46 +1,747 @@
 #include "date.h"
 #include "tldlist.h"
+#include "logline.h"
+#include "ingest.h"
+#include "mem.h"
+#include "report.h"
+#include "follow.h"
+#include "tldstore.h"
+#include "stats.h"
+#include "decode.h"
+#include "readahead.h"
+#include "serve.h"
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define USAGE "usage: %s begin_datestamp end_datestamp [file] ...\n"
+#define USAGE "usage: %s [-v] [-j threads] [-b avl|hash] [--sort=count|name] [--top K] [--follow [--interval SECS] [--every LINES] | --serve SOCKET] [--range begin:end] ... [--depth N] [--distinct] [--key=tld|host [--max-mem SIZE]] [--sorted] [--save FILE] [--stats[=json]] {begin_datestamp end_datestamp [file] ... | --load FILE [--verify]}\n"
+#define MINCHUNK (1 << 16)
+#define MAXTHREADS 256
+#define FOLLOWINTERVAL 10       /* seconds between --follow reports by default */
+#define FOLLOWPOLL 200          /* milliseconds to wait when nothing was appended */
+#define SERVEPOLL 20            /* the same for --serve, whose queries want fresh counts */
+#define MAXRANGES 64
+#define MAXDEPTH 32             /* most domain levels --depth will count */
 
-static void process(FILE *fd, TLDList *tld) {
-    char bf[1024], sbf[1024];
-    Date *d;
-    while (fgets(bf, sizeof(bf), fd) != NULL) {
-        char *q, *p = strchr(bf, ' ');
-	if (p == NULL) {
-            fprintf(stderr, "Illegal input line: %s", bf);
-	    return;
+struct range {
+    const char *text;
+    uint32_t begin, end;
+};
+
+struct chunk {
+    const char *start, *end;
+    const char *bad;
+    TLDList *tld;
+    unsigned long lines;
+    uint32_t last;              /* with --sorted, the date order as ingest_sorted() left it */
+};
+
+static int nthreads = 1;
+static int verbose = 0;
+static enum report_order order = REPORT_UNSORTED;
+static long top = 0;
+static int following = 0;
+static long interval = 0;
+static long every = 0;
+static volatile sig_atomic_t stopping = 0;
+static struct range ranges[MAXRANGES];
+static int nranges = 0;
+static int depth = 1;
+static int distinct = 0;
+static int hostkeys = 0;        /* --key=host */
+static size_t maxmem = 0;       /* --max-mem, 0 for no limit */
+static int sorted = 0;          /* --sorted */
+static const char *savepath = NULL;
+static const char *loadpath = NULL;
+static int verify = 0;          /* --verify */
+static const char *servepath = NULL;
+#if TLDSTATS
+static int stats = 0;           /* 1 for --stats, 2 for --stats=json */
+#endif
+
+static const struct option options[] = {
+    {"verbose", no_argument, NULL, 'v'},
+    {"threads", required_argument, NULL, 'j'},
+    {"backend", required_argument, NULL, 'b'},
+    {"sort", required_argument, NULL, 's'},
+    {"top", required_argument, NULL, 't'},
+    {"follow", no_argument, NULL, 'f'},
+    {"interval", required_argument, NULL, 'i'},
+    {"every", required_argument, NULL, 'e'},
+    {"range", required_argument, NULL, 'r'},
+    {"depth", required_argument, NULL, 'D'},
+    {"distinct", no_argument, NULL, 'u'},
+    {"key", required_argument, NULL, 'k'},
+    {"max-mem", required_argument, NULL, 'M'},
+    {"sorted", no_argument, NULL, 'o'},
+    {"save", required_argument, NULL, 'S'},
+    {"load", required_argument, NULL, 'L'},
+    {"verify", no_argument, NULL, 'V'},
+    {"serve", required_argument, NULL, 'q'},
+    {"stats", optional_argument, NULL, 'T'},
+    {NULL, 0, NULL, 0}
+};
+static unsigned long nlines = 0;
+static enum tldlist_backend backend = TLDLIST_DEFAULT_BACKEND;
+
+/*
+ * process counts the log lines of the descriptor `fd', named `name' in
+ * messages, which could not be mapped; the `len' bytes at `head' were read
+ * from it already
+ */
+static void process(int fd, const char *head, size_t len, const char *name, TLDList *tld) {
+    if (readahead_stream(fd, head, len, tld, &nlines) < 0)
+        fprintf(stderr, "Unable to read %s\n", name);
+}
+
+/*
+ * process_decoded counts the compressed log read from `fd', named `name' in
+ * messages; the `len' bytes at `head' were read from it already
+ */
+static void process_decoded(int fd, const char *head, size_t len, enum decode_format format,
+                            const char *name, TLDList *tld) {
+    if (!decode_supported(format))
+        fprintf(stderr, "Unable to read %s: %s support was not built in\n", name, decode_name(format));
+    else if (decode_stream(fd, head, len, format, tld, &nlines) < 0)
+        fprintf(stderr, "Unable to decode %s: corrupt or truncated %s data\n", name, decode_name(format));
+}
+
+/*
+ * process_stream counts the log read from `fd', named `name' in messages,
+ * decompressing it if it starts with the magic number of a compressed
+ * format; it is for input that cannot be read at an offset, like standard
+ * input or a pipe, so its first byte is read and handed on, not peeked at
+ */
+static void process_stream(int fd, const char *name, TLDList *tld) {
+    char c;
+    ssize_t got;
+    enum decode_format format;
+
+    // One byte straight from the descriptor, handed on to whichever reads the rest
+    do
+        got = read(fd, &c, 1);
+    while (got < 0 && errno == EINTR);
+    format = (got == 1) ? decode_detect(&c, 1) : DECODE_NONE;
+    if (format == DECODE_NONE)
+        process(fd, &c, (got == 1) ? 1 : 0, name, tld);
+    else
+        process_decoded(fd, &c, 1, format, name, tld);
+}
+
+/*
+ * process_buffer counts the log lines of chunk `c' in place, recording the
+ * first illegal line, at which counting stopped, in c->bad, and with
+ * --sorted checking the lines are in date order as it goes
+ */
+static void process_buffer(struct chunk *c) {
+    c->lines = 0;
+    c->last = 0;
+    if (sorted)
+        (void) ingest_sorted(c->tld, c->start, c->end - c->start, 1, &c->bad, &c->lines, &c->last);
+    else
+        (void) ingest_lines(c->tld, c->start, c->end - c->start, 1, &c->bad, &c->lines);
+}
+
+/*
+ * parse_range reads a "dd/mm/yyyy:dd/mm/yyyy" --range argument into `r'
+ * returns 1 if successful, 0 if not
+ */
+static int parse_range(const char *s, struct range *r) {
+    if (strlen(s) != 21 || s[10] != ':')
+        return 0;
+    if (!date_parse_packed(s, &r->begin) || !date_parse_packed(s + 11, &r->end))
+        return 0;
+    r->text = s;
+    return r->begin <= r->end;
+}
+
+/*
+ * parse_size reads a --max-mem argument, a number of bytes with an optional
+ * K, M or G suffix, into `*size'
+ * returns 1 if successful, 0 if not
+ */
+static int parse_size(const char *s, size_t *size) {
+    char *rest;
+    unsigned long long n;
+    int shift = 0;
+
+    if (*s < '0' || *s > '9')
+        return 0;
+    n = strtoull(s, &rest, 10);
+    if (*rest == 'K' || *rest == 'k')
+        shift = 10;
+    else if (*rest == 'M' || *rest == 'm')
+        shift = 20;
+    else if (*rest == 'G' || *rest == 'g')
+        shift = 30;
+    if (shift > 0)
+        rest++;
+    if (*rest != '\0' || n > (SIZE_MAX >> shift))
+        return 0;
+    *size = (size_t)n << shift;
+    return 1;
+}
+
+/*
+ * print_reports writes the report of `tld', or of the snapshot `store' when
+ * there is no list, or with --range one report per range, each under a
+ * "# begin:end" line, or with --depth the tree of domain suffixes, or with
+ * --key=host the full hostnames
+ * returns 0 if successful, -1 if not
+ */
+static int print_reports(TLDList *tld, TLDStore *store) {
+    int i;
+
+    if (tld == NULL) {
+        if (nranges == 0)
+            return report_print_store(store, order, top, stdout);
+        for (i = 0; i < nranges; i++) {
+            printf("# %s\n", ranges[i].text);
+            if (report_print_store_range(store, ranges[i].begin, ranges[i].end, order, top, stdout) < 0)
+                return -1;
         }
-	strcpy(sbf, bf);
-	*p++ = '\0';
-	while (*p == ' ')
-            p++;
-	q = strchr(p, '\n');
-	if (q == NULL) {
-            fprintf(stderr, "Illegal input line: %s", sbf);
-	    return;
+        return 0;
+    }
+    if (hostkeys)
+        return report_print_hosts(tld, order, top, stdout);
+    if (depth > 1)
+        return report_print_depth(tld, order, top, stdout);
+    if (nranges == 0)
+        return report_print(tld, order, top, stdout);
+    for (i = 0; i < nranges; i++) {
+        printf("# %s\n", ranges[i].text);
+        if (report_print_range(tld, ranges[i].begin, ranges[i].end, order, top, stdout) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * new_list creates an empty TLDList for `begin'..`end', keeping day buckets
+ * when there are ranges to report, a snapshot to save or queries to serve,
+ * counting domain suffixes for --depth, sketching distinct hostnames for
+ * --distinct and counting full hostnames for --key=host
+ */
+static TLDList *new_list(Date *begin, Date *end) {
+    TLDList *tld;
+    size_t limit = maxmem;
+
+    // With -j the merged list and one per thread are all alive at once
+    if (limit > 0 && nthreads > 1) {
+        limit /= nthreads + 1;
+        if (limit < HOSTTABLE_MIN_MEM)
+            limit = HOSTTABLE_MIN_MEM;
+    }
+
+    if (nranges > 0 || savepath != NULL || servepath != NULL)
+        tld = tldlist_create_bucketed(begin, end, backend);
+    else
+        tld = tldlist_create_backend(begin, end, backend);
+    if (tld != NULL && ((depth > 1 && !tldlist_set_depth(tld, depth)) ||
+                        (distinct && !tldlist_set_distinct(tld)) ||
+                        (hostkeys && !tldlist_set_hosts(tld, limit)))) {
+        tldlist_destroy(tld);
+        return NULL;
+    }
+    return tld;
+}
+
+static void stop(int sig) {
+    (void) sig;
+    stopping = 1;
+}
+
+/*
+ * follow_files tails `paths' until interrupted, printing a report of `tld'
+ * every `interval' seconds and/or every `every' lines, and once more on exit
+ * returns 0 if successful, -1 if not
+ */
+static int follow_files(char **paths, int n, TLDList *tld) {
+    struct sigaction sa;
+    struct timespec now, pause = { 0, FOLLOWPOLL * 1000000L };
+    time_t next;
+    unsigned long got, pending = 0;
+    Follower *f = follow_create(tld);
+    int i, status = 0;
+
+    if (f == NULL)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (follow_add(f, paths[i]) < 0) {
+            follow_destroy(f);
+            return -1;
+        }
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    if (interval == 0 && every == 0)
+        interval = FOLLOWINTERVAL;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    next = now.tv_sec + interval;
+    for (;;) {
+        got = follow_poll(f);
+        pending += got;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (stopping || (every > 0 && pending >= (unsigned long)every) || (interval > 0 && now.tv_sec >= next)) {
+            printf("# %lu lines read\n", follow_lines(f));
+            STATS_START(reporting);
+            if (print_reports(tld, NULL) < 0) {
+                fprintf(stderr, "Unable to write report\n");
+                status = -1;
+                break;
+            }
+            STATS_STOP(STATS_REPORT, reporting);
+            pending = 0;
+            next = now.tv_sec + interval;
         }
-	*q = '\0';
-	d = date_create(bf);
-	(void) tldlist_add(tld, p, d);
-	date_destroy(d);
+        if (stopping)
+            break;
+        if (got == 0)
+            nanosleep(&pause, NULL);
     }
+    nlines += follow_lines(f);
+    follow_destroy(f);
+    return status;
+}
+
+/*
+ * serve_files tails `paths' until interrupted, as follow_files does, while
+ * a server thread answers queries about `tld' on the --serve socket; lines
+ * are counted into a list of their own, handed to the server whenever it
+ * has taken the last one, so a query never holds up the reading
+ * returns 0 if successful, -1 if not
+ */
+static int serve_files(char **paths, int n, TLDList *tld, Date *begin, Date *end) {
+    struct sigaction sa;
+    struct timespec pause = { 0, SERVEPOLL * 1000000L };
+    TLDList *delta = new_list(begin, end), *spare = NULL;
+    Follower *f = NULL;
+    Server *s = NULL;
+    unsigned long got;
+    int i, status = -1;
+
+    if (delta == NULL || (f = follow_create(delta)) == NULL)
+        goto done;
+    for (i = 0; i < n; i++)
+        if (follow_add(f, paths[i]) < 0)
+            goto done;
+    s = serve_create(servepath, tld);
+    if (s == NULL) {
+        fprintf(stderr, "Unable to serve on %s\n", servepath);
+        goto done;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    status = 0;
+    while (!stopping) {
+        got = follow_poll(f);
+        // The next list is made ready before it's needed, so a handover costs nothing
+        if (spare == NULL && (spare = new_list(begin, end)) == NULL) {
+            status = -1;
+            break;
+        }
+        if (tldlist_count(delta) > 0 && serve_offer(s, delta)) {
+            delta = spare;
+            spare = NULL;
+            follow_set_list(f, delta);
+        }
+        if (got == 0)
+            nanosleep(&pause, NULL);
+    }
+    (void) serve_stop(s);
+    if (!tldlist_merge(tld, delta))
+        status = -1;
+
+done:
+    if (f != NULL) {
+        nlines += follow_lines(f);
+        follow_destroy(f);
+    }
+    if (delta != NULL)
+        tldlist_destroy(delta);
+    if (spare != NULL)
+        tldlist_destroy(spare);
+    return status;
+}
+
+static void *process_chunk(void *arg) {
+    process_buffer((struct chunk *)arg);
+    stats_flush();
+    return NULL;
+}
+
+/*
+ * process_parallel splits `buf' into newline-aligned chunks, counts each in
+ * a private TLDList on its own thread and merges the lists into `tld' in
+ * file order, so the result matches a single-threaded pass exactly; with
+ * --sorted, `*ordered' is cleared if the lines are not in date order
+ * returns 1 if counting stopped at an illegal line, 0 if not, and -1 if the
+ * chunks could not be set up, in which case nothing has been counted
+ */
+static int process_parallel(const char *buf, size_t len, TLDList *tld, Date *begin, Date *end, int *ordered) {
+    struct chunk chunks[MAXTHREADS];
+    pthread_t tids[MAXTHREADS];
+    const char *bad = NULL, *p, *q, *nl;
+    int i, n, started, status = 0;
+
+    n = (len / MINCHUNK < (size_t)nthreads) ? (int)(len / MINCHUNK) : nthreads;
+    if (n < 2)
+        return -1;
+    p = buf;
+    for (i = 0; i < n; i++) {
+        chunks[i].start = p;
+        if (i == n - 1) {
+            p = buf + len;
+        } else {
+            q = buf + len / n * (i + 1);
+            if (q < p)
+                q = p;
+            nl = memchr(q, '\n', buf + len - q);
+            p = (nl == NULL) ? buf + len : nl + 1;
+        }
+        chunks[i].end = p;
+        chunks[i].bad = NULL;
+        chunks[i].tld = new_list(begin, end);
+    }
+    for (started = 0; started < n; started++) {
+        if (chunks[started].tld == NULL)
+            break;
+        if (pthread_create(&tids[started], NULL, process_chunk, &chunks[started]) != 0)
+            break;
+    }
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    if (started < n) {
+        status = -1;
+    } else {
+        // everything after the first illegal line is discarded, as it would
+        // never have been read by the single-threaded loop
+        for (i = 0; i < n && bad == NULL; i++) {
+            if (!tldlist_merge(tld, chunks[i].tld))
+                fprintf(stderr, "Unable to merge TLD counts\n");
+            nlines += chunks[i].lines;
+            bad = chunks[i].bad;
+        }
+        if (bad != NULL)
+            ingest_illegal(bad, buf + len);
+        // each chunk checked its own order, but not that it follows on from the one before
+        for (i = 0; sorted && i < n; i++) {
+            uint32_t first = ingest_date(chunks[i].start, buf + len);
+            if (chunks[i].last == INGEST_UNSORTED || (i > 0 && first != 0 && first < chunks[i - 1].last))
+                *ordered = 0;
+        }
+        status = (bad != NULL);
+    }
+    for (i = 0; i < n; i++)
+        if (chunks[i].tld != NULL)
+            tldlist_destroy(chunks[i].tld);
+    return status;
+}
+
+/*
+ * process_region counts the `len' bytes at `buf', splitting them across
+ * threads when -j was given; with --sorted, `*ordered' is cleared if the
+ * lines are not in date order
+ * returns 1 if counting stopped at an illegal line, 0 if not
+ */
+static int process_region(const char *buf, size_t len, TLDList *tld, Date *begin, Date *end, int *ordered) {
+    struct chunk c;
+    int status;
+
+    if (len == 0)
+        return 0;
+    if (nthreads > 1 && (status = process_parallel(buf, len, tld, begin, end, ordered)) >= 0)
+        return status;
+    c.start = buf;
+    c.end = buf + len;
+    c.tld = tld;
+    process_buffer(&c);
+    nlines += c.lines;
+    if (sorted && c.last == INGEST_UNSORTED)
+        *ordered = 0;
+    if (c.bad != NULL)
+        ingest_illegal(c.bad, c.end);
+    return c.bad != NULL;
+}
+
+/*
+ * process_mapped maps the regular file open on `fd', named `name' in
+ * messages, and parses it in place; with --sorted only the lines dated
+ * within the window are read, found by binary search, unless they or the
+ * dated lines either side of them turn out not to be in date order, when
+ * the whole file is read after all; disorder further from the window goes
+ * unseen, and lines dated within it there are missed
+ * returns 0 if the file was processed, -1 if it cannot be mapped, in which
+ * case the caller falls back to process()
+ */
+static int process_mapped(int fd, const char *name, TLDList *tld, Date *begin, Date *end) {
+    struct stat st;
+    const char *base, *from, *to;
+    size_t skip;
+    unsigned long counted = nlines;
+    TLDList *window = NULL;
+    void *map;
+    int ordered = 1;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        return -1;
+    if (st.st_size == 0)
+        return 0;
+    // Pages are faulted in as they are parsed, so most of the reading shows up as parse time
+    STATS_START(reading);
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    base = from = map;
+    to = base + st.st_size;
+    if (sorted)
+        ordered = ingest_window(base, (size_t)st.st_size, date_pack(begin), date_pack(end), &from, &to);
+    // Read ahead over the window only, from the page it starts in
+    skip = (size_t)(from - base) & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+    (void) madvise((char *)map + skip, (size_t)(to - base) - skip, MADV_SEQUENTIAL);
+    STATS_STOP(STATS_READ, reading);
+
+    // The window is counted into a list of its own, so that it can be thrown
+    // away if the file is not in order, and the whole file read in order instead
+    if (sorted && ordered && (window = new_list(begin, end)) != NULL &&
+        (process_region(from, to - from, window, begin, end, &ordered) == 1 || ordered)) {
+        if (!tldlist_merge(tld, window))
+            fprintf(stderr, "Unable to merge TLD counts\n");
+    } else {
+        if (sorted && !ordered) {
+            fprintf(stderr, "%s is not sorted by date, reading all of it\n", name);
+            nlines = counted;
+            (void) madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+        }
+        (void) process_region(base, (size_t)st.st_size, tld, begin, end, &ordered);
+    }
+    if (window != NULL)
+        tldlist_destroy(window);
+    munmap(map, (size_t)st.st_size);
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     Date *begin = NULL, *end = NULL;
-    int i;
-    FILE *fd;
+    unsigned char head[4];
+    enum decode_format format;
+    ssize_t got;
+    int i, fd, opt;
+    char *prog = argv[0];
     TLDList *tld = NULL;
-    TLDIterator *it = NULL;
-    TLDNode *n;
-    double total;
+    TLDStore *store = NULL;
 
+    while ((opt = getopt_long(argc, argv, "vj:b:s:t:fi:e:r:D:uk:M:oS:L:q:T::", options, NULL)) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            if (nthreads < 1 || nthreads > MAXTHREADS) {
+                fprintf(stderr, "Illegal thread count: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'b':
+            if (strcmp(optarg, "avl") == 0)
+                backend = TLDLIST_AVL;
+            else if (strcmp(optarg, "hash") == 0)
+                backend = TLDLIST_HASH;
+            else {
+                fprintf(stderr, "Unknown TLD list backend: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 's':
+            if (strcmp(optarg, "count") == 0)
+                order = REPORT_BY_COUNT;
+            else if (strcmp(optarg, "name") == 0)
+                order = REPORT_BY_NAME;
+            else {
+                fprintf(stderr, "Unknown sort order: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 't':
+            top = atol(optarg);
+            if (top < 1) {
+                fprintf(stderr, "Illegal top count: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'f':
+            following = 1;
+            break;
+        case 'i':
+            interval = atol(optarg);
+            if (interval < 1) {
+                fprintf(stderr, "Illegal report interval: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'e':
+            every = atol(optarg);
+            if (every < 1) {
+                fprintf(stderr, "Illegal report line count: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            if (nranges == MAXRANGES) {
+                fprintf(stderr, "Too many ranges, at most %d\n", MAXRANGES);
+                return -1;
+            }
+            if (!parse_range(optarg, &ranges[nranges])) {
+                fprintf(stderr, "Illegal date range: %s\n", optarg);
+                return -1;
+            }
+            nranges++;
+            break;
+        case 'D':
+            depth = atoi(optarg);
+            if (depth < 1 || depth > MAXDEPTH) {
+                fprintf(stderr, "Illegal depth: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'u':
+            distinct = 1;
+            break;
+        case 'k':
+            if (strcmp(optarg, "host") == 0)
+                hostkeys = 1;
+            else if (strcmp(optarg, "tld") == 0)
+                hostkeys = 0;
+            else {
+                fprintf(stderr, "Unknown key: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'M':
+            if (!parse_size(optarg, &maxmem) || maxmem < HOSTTABLE_MIN_MEM) {
+                fprintf(stderr, "Illegal memory limit: %s (at least %ldK)\n", optarg, HOSTTABLE_MIN_MEM >> 10);
+                return -1;
+            }
+            break;
+        case 'o':
+            sorted = 1;
+            break;
+        case 'S':
+            savepath = optarg;
+            break;
+        case 'L':
+            loadpath = optarg;
+            break;
+        case 'V':
+            verify = 1;
+            break;
+        case 'q':
+            servepath = optarg;
+            break;
+        case 'T':
+#if TLDSTATS
+            if (optarg == NULL)
+                stats = 1;
+            else if (strcmp(optarg, "json") == 0)
+                stats = 2;
+            else {
+                fprintf(stderr, "Unknown stats format: %s\n", optarg);
+                return -1;
+            }
+            stats_timing = 1;
+            break;
+#else
+            fprintf(stderr, "Statistics were compiled out of this build\n");
+            return -1;
+#endif
+        default:
+            fprintf(stderr, USAGE, prog);
+            return -1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    if (depth > 1 && (nranges > 0 || loadpath != NULL)) {
+        // Suffixes are kept for the whole window only, and snapshots hold none
+        fprintf(stderr, "--depth cannot be combined with --range or --load\n");
+        return -1;
+    }
+    if (distinct && (nranges > 0 || depth > 1)) {
+        // Sketches cover the whole window, and only TLDs have them
+        fprintf(stderr, "--distinct cannot be combined with --range or --depth\n");
+        return -1;
+    }
+    if (servepath != NULL && (nranges > 0 || depth > 1 || hostkeys || savepath != NULL || loadpath != NULL || following)) {
+        // Ranges come with each query, and the counts live as long as the server
+        fprintf(stderr, "--serve cannot be combined with --range, --depth, --key=host, --save, --load or --follow\n");
+        return -1;
+    }
+    if (hostkeys && (nranges > 0 || depth > 1 || distinct || savepath != NULL || loadpath != NULL || following)) {
+        // Hostnames are counted for the whole window, read once, and never saved
+        fprintf(stderr, "--key=host cannot be combined with --range, --depth, --distinct, --save, --load or --follow\n");
+        return -1;
+    }
+    if (sorted && (following || servepath != NULL || loadpath != NULL)) {
+        // Only whole files, read once, can be searched
+        fprintf(stderr, "--sorted cannot be combined with --follow, --serve or --load\n");
+        return -1;
+    }
+    if (maxmem > 0 && !hostkeys) {
+        fprintf(stderr, "--max-mem needs --key=host\n");
+        return -1;
+    }
+    if (verify && loadpath == NULL) {
+        fprintf(stderr, "--verify needs --load\n");
+        return -1;
+    }
+    if (loadpath != NULL) {
+        // A snapshot brings its own window and counts, there is nothing to read
+        if (argc != 1 || following) {
+            fprintf(stderr, USAGE, prog);
+            return -1;
+        }
+        store = tldstore_open(loadpath);
+        if (store == NULL) {
+            fprintf(stderr, "Unable to load snapshot %s\n", loadpath);
+            goto error;
+        }
+        if (verify && !tldstore_verify(store)) {
+            fprintf(stderr, "Snapshot %s does not match its checksum\n", loadpath);
+            goto error;
+        }
+        if (nranges > 0 && tldstore_count_range(store, ranges[0].begin, ranges[0].end) < 0) {
+            fprintf(stderr, "Snapshot %s has no day buckets for --range\n", loadpath);
+            goto error;
+        }
+        if (distinct && !tldstore_has_sketches(store)) {
+            fprintf(stderr, "Snapshot %s has no sketches for --distinct\n", loadpath);
+            goto error;
+        }
+        // Reports are answered from the mapping, only saving it again needs a list
+        if (savepath != NULL && (tld = tldlist_load(loadpath, backend)) == NULL) {
+            fprintf(stderr, "Unable to load snapshot %s\n", loadpath);
+            goto error;
+        }
+        goto report;
+    }
     if (argc < 3) {
-        fprintf(stderr, USAGE, argv[0]);
+        fprintf(stderr, USAGE, prog);
         return -1;
     }
     begin = date_create(argv[1]);
@@ -57,46 +758,88 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "%s > %s\n", argv[1], argv[2]);
 	goto error;
     }
-    tld = tldlist_create(begin, end);
+    tld = new_list(begin, end);
     if (tld == NULL) {
         fprintf(stderr, "Unable to create TLD list\n");
         goto error;
     }
-    if (argc == 3)
-        process(stdin, tld);
+    if (following) {
+        char *dash[] = { "-" };
+        if (follow_files((argc == 3) ? dash : argv + 3, (argc == 3) ? 1 : argc - 3, tld) < 0) {
+            fprintf(stderr, "Unable to follow input\n");
+            goto error;
+        }
+    } else if (servepath != NULL) {
+        char *dash[] = { "-" };
+        if (serve_files((argc == 3) ? dash : argv + 3, (argc == 3) ? 1 : argc - 3, tld, begin, end) < 0) {
+            fprintf(stderr, "Unable to serve input\n");
+            goto error;
+        }
+    } else if (argc == 3)
+        process_stream(STDIN_FILENO, "standard input", tld);
     else {
         for (i = 3; i < argc; i++) {
-            if (strcmp(argv[i], "-") == 0)
-                fd = stdin;
-            else
-                fd = fopen(argv[i], "r");
-            if (fd == NULL) {
+            if (strcmp(argv[i], "-") == 0) {
+                process_stream(STDIN_FILENO, "standard input", tld);
+                continue;
+            }
+            fd = open(argv[i], O_RDONLY);
+            if (fd < 0) {
                 fprintf(stderr, "Unable to open %s\n", argv[i]);
                 continue;
             }
-            process(fd, tld);
-            if (fd != stdin)
-                fclose(fd);
+            // Files that can be read at an offset are sniffed in place, pipes through their first byte
+            got = pread(fd, head, sizeof(head), 0);
+            if (got < 0 && errno == ESPIPE) {
+                process_stream(fd, argv[i], tld);
+                close(fd);
+                continue;
+            }
+            format = decode_detect(head, (got < 0) ? 0 : (size_t)got);
+            if (format != DECODE_NONE) {
+                // pread left the offset alone, so the decoder starts from the top
+                process_decoded(fd, NULL, 0, format, argv[i], tld);
+                close(fd);
+                continue;
+            }
+            if (process_mapped(fd, argv[i], tld, begin, end) == 0) {
+                close(fd);
+                continue;
+            }
+            process(fd, NULL, 0, argv[i], tld);
+            close(fd);
         }
     }
-    total = (double)tldlist_count(tld);
-    it = tldlist_iter_create(tld);
-    if (it == NULL) {
-        fprintf(stderr, "Unable to create iterator\n");
+report:
+    if (verbose)
+        fprintf(stderr, "%lu lines read, %lu heap allocations\n", nlines, mem_allocations());
+    if (verbose && hostkeys)
+        fprintf(stderr, "%d host runs spilled\n", hosttable_runs(tldlist_hosts(tld)));
+    if (savepath != NULL && tldlist_save(tld, savepath) < 0) {
+        fprintf(stderr, "Unable to save snapshot %s\n", savepath);
+        goto error;
+    }
+    STATS_START(reporting);
+    if (!following && print_reports(tld, store) < 0) {
+        fprintf(stderr, "Unable to write report\n");
         goto error;
     }
-    while ((n = tldlist_iter_next(it))) {
-        printf("%6.2f %s %ld\n", 100.0 * (double)tldnode_count(n)/total, tldnode_tldname(n), tldnode_count(n));
+    STATS_STOP(STATS_REPORT, reporting);
+#if TLDSTATS
+    if (stats) {
+        stats_flush();
+        stats_print(stderr, stats == 2, mem_allocations());
     }
+#endif
 
-    tldlist_iter_destroy(it);
-    tldlist_destroy(tld);
-    date_destroy(begin);
-    date_destroy(end);
+    if (tld != NULL)	tldlist_destroy(tld);
+    if (store != NULL)	tldstore_close(store);
+    if (end != NULL)	date_destroy(end);
+    if (begin != NULL)	date_destroy(begin);
     return 0;
 error:
-    if (it != NULL)	tldlist_iter_destroy(it);
     if (tld != NULL)	tldlist_destroy(tld);
+    if (store != NULL)	tldstore_close(store);
     if (end != NULL)	date_destroy(end);
     if (begin != NULL)	date_destroy(begin);
     return -1;
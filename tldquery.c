@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * tldquery sends one query to a tldmonitor --serve socket and prints the
+ * reply; with -n it is a load test instead: each of -c connections sends
+ * the query -n times, waiting for every reply before sending again, and
+ * the latencies of all the replies are summed up at the end
+ */
+
+#define USAGE "usage: %s [-n requests] [-c connections] socket query ...\n"
+#define MAXCONNS 256
+#define MAXQUERY 256
+#define READBUF (1 << 16)
+
+struct conn {
+    int fd;
+    int body;                   /* the query is a TOP, whose reply has lines after the first */
+    const char *query;
+    size_t len;
+    long requests;
+    double *latency;            /* of each reply, in seconds */
+    int failed;
+    size_t have;
+    char buf[READBUF];
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * read_line reads the next line of a reply into `out', without its newline
+ * returns 1 if successful, 0 if the connection closed or failed first
+ */
+static int read_line(struct conn *c, char *out, size_t cap) {
+    char *nl;
+    ssize_t got;
+
+    while ((nl = memchr(c->buf, '\n', c->have)) == NULL) {
+        if (c->have == READBUF)
+            return 0;
+        got = read(c->fd, c->buf + c->have, READBUF - c->have);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        c->have += got;
+    }
+    size_t len = nl - c->buf;
+    if (out != NULL) {
+        size_t n = (len < cap - 1) ? len : cap - 1;
+        memcpy(out, c->buf, n);
+        out[n] = '\0';
+    }
+    c->have -= len + 1;
+    memmove(c->buf, nl + 1, c->have);
+    return 1;
+}
+
+/*
+ * request sends the query and reads the whole reply, printing it if `fp'
+ * is not NULL
+ * returns 0 if the reply was OK, -1 if not
+ */
+static int request(struct conn *c, FILE *fp) {
+    char line[READBUF];
+    long lines = 0;
+    size_t sent = 0;
+    ssize_t n;
+
+    while (sent < c->len) {
+        n = write(c->fd, c->query + sent, c->len - sent);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        sent += n;
+    }
+    if (!read_line(c, line, sizeof(line)))
+        return -1;
+    if (fp != NULL)
+        fprintf(fp, "%s\n", line);
+    if (strncmp(line, "OK ", 3) != 0)
+        return -1;
+    if (c->body)
+        lines = atol(line + 3);
+    while (lines-- > 0) {
+        if (!read_line(c, (fp != NULL) ? line : NULL, sizeof(line)))
+            return -1;
+        if (fp != NULL)
+            fprintf(fp, "%s\n", line);
+    }
+    return 0;
+}
+
+static void *load(void *arg) {
+    struct conn *c = arg;
+    double t;
+
+    for (long i = 0; i < c->requests; i++) {
+        t = now();
+        if (request(c, NULL) < 0) {
+            c->failed = 1;
+            break;
+        }
+        c->latency[i] = now() - t;
+    }
+    return NULL;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* the latency below which `p' percent of the sorted `n' fall, in microseconds */
+static double percentile(const double *sorted, long n, double p) {
+    long i = (long)(p / 100.0 * n);
+    return 1e6 * sorted[(i < n) ? i : n - 1];
+}
+
+int main(int argc, char *argv[]) {
+    static struct conn conns[MAXCONNS];
+    pthread_t tids[MAXCONNS];
+    char query[MAXQUERY];
+    long requests = 0, total = 0;
+    int nconns = 1, opt, i, status = 0;
+    size_t len = 0;
+    double *all, start, seconds;
+
+    while ((opt = getopt(argc, argv, "n:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            requests = atol(optarg);
+            break;
+        case 'c':
+            nconns = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return -1;
+        }
+    }
+    if (argc - optind < 2 || nconns < 1 || nconns > MAXCONNS || requests < 0) {
+        fprintf(stderr, USAGE, argv[0]);
+        return -1;
+    }
+    for (i = optind + 1; i < argc; i++) {
+        size_t n = strlen(argv[i]);
+        if (len + n + 1 >= MAXQUERY) {
+            fprintf(stderr, "Query too long\n");
+            return -1;
+        }
+        memcpy(query + len, argv[i], n);
+        len += n;
+        query[len++] = (i == argc - 1) ? '\n' : ' ';
+    }
+
+    for (i = 0; i < nconns; i++) {
+        conns[i].fd = connect_to(argv[optind]);
+        if (conns[i].fd < 0) {
+            fprintf(stderr, "Unable to connect to %s\n", argv[optind]);
+            return -1;
+        }
+        conns[i].query = query;
+        conns[i].len = len;
+        conns[i].body = (strncmp(query, "TOP ", 4) == 0);
+        conns[i].requests = requests;
+    }
+    if (requests == 0)
+        return (request(&conns[0], stdout) < 0) ? -1 : 0;
+
+    all = malloc((size_t)requests * nconns * sizeof(double));
+    if (all == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    for (i = 0; i < nconns; i++)
+        conns[i].latency = all + (size_t)i * requests;
+    start = now();
+    for (i = 0; i < nconns; i++) {
+        if (pthread_create(&tids[i], NULL, load, &conns[i]) != 0) {
+            fprintf(stderr, "Unable to start connection %d\n", i);
+            return -1;
+        }
+    }
+    for (i = 0; i < nconns; i++)
+        pthread_join(tids[i], NULL);
+    seconds = now() - start;
+
+    /* a failed connection stops short, so only the replies it had are counted */
+    for (i = 0; i < nconns; i++) {
+        if (conns[i].failed) {
+            fprintf(stderr, "Connection %d failed\n", i);
+            status = -1;
+            continue;
+        }
+        memmove(all + total, conns[i].latency, requests * sizeof(double));
+        total += requests;
+        close(conns[i].fd);
+    }
+    if (total > 0) {
+        qsort(all, total, sizeof(double), by_value);
+        printf("%ld replies on %d connections in %.3f s, %.0f/s\n", total, nconns, seconds, total / seconds);
+        printf("latency us: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+               1e6 * all[0], percentile(all, total, 50), percentile(all, total, 90),
+               percentile(all, total, 99), percentile(all, total, 99.9), 1e6 * all[total - 1]);
+    }
+    free(all);
+    return status;
+}
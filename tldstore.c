@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tldstore.h"
+#include "date.h"
+#include "mem.h"
+#include "hll.h"
+
+// Macros and Enumerations
+#define STORE_MAGIC "TLDSNAP"   // Eight bytes with the terminator
+#define STORE_VERSION 2        // 2 added the sketches
+#define STORE_BYTEORDER 0x01020304U
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+// Definitions for each structure
+struct tldstore_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;         // STORE_BYTEORDER as the saving host wrote it
+    uint32_t first_day;         // The window, packed, see date_pack
+    uint32_t last_day;
+    int64_t total;
+    uint64_t size;              // Keys in the table
+    uint64_t ndays;             // Days per row of sums, 0 without buckets
+    uint64_t registers;         // Bytes per sketch, 0 without sketches
+    uint64_t keys;              // Offsets of each section from the start of the file
+    uint64_t sums;
+    uint64_t sketches;
+    uint64_t names;
+    uint64_t length;            // Of the whole file
+    uint64_t checksum;          // FNV-1a of the file with this field zeroed
+};
+
+struct tldstore_key {
+    uint32_t name;              // Offset into the names section
+    uint32_t len;
+    int64_t count;
+};
+
+struct tldstore {
+    const unsigned char *base;
+    size_t length;
+    const struct tldstore_header *header;
+    const struct tldstore_key *keys;
+    const int64_t *sums;
+    const uint8_t *sketches;
+    const char *names;
+    long day0;                  // Day number of first_day, see date_days
+};
+
+struct saver {
+    FILE *fp;
+    uint64_t checksum;
+    int error;
+};
+
+// File Specific Prototypes
+static uint64_t checksum(uint64_t hash, const void *p, size_t n);
+static void put(struct saver *s, const void *p, size_t n);
+static int by_name(const void *a, const void *b);
+static void put_sums(struct saver *s, TLDList *tld, TLDNode *node, uint32_t first, long ndays);
+static int store_check(TLDStore *store);
+static uint64_t store_checksum(TLDStore *store);
+static long store_range(TLDStore *store, long row, uint32_t begin, uint32_t end);
+
+/*
+/
+/ Saving and Loading
+/
+*/
+
+int tldlist_save(TLDList *tld, const char *path) {
+    struct tldstore_header h;
+    struct tldstore_key key;
+    struct saver s = { NULL, FNV_OFFSET, 0 };
+    TLDIterator *it = NULL;
+    TLDNode **nodes = NULL, *node;
+    char *tmp = NULL;
+    uint32_t first, last;
+    uint64_t offset = 0;
+    long i, n = 0, size = tldlist_size(tld);
+    int status = -1;
+
+    // Keys go out sorted, so tldstore_find can binary search them in place
+    tldlist_window(tld, &first, &last);
+    nodes = (TLDNode **) mem_malloc((size > 0 ? size : 1) * sizeof(TLDNode *));
+    it = tldlist_iter_create(tld);
+    tmp = (char *) mem_malloc(strlen(path) + 5);
+    // With the sums built, a range count below fails only for a list without buckets
+    if (nodes == NULL || it == NULL || tmp == NULL || !tldlist_prefix(tld)) { goto done; }
+    while ((node = tldlist_iter_next(it)) != NULL && n < size) {
+        nodes[n++] = node;
+    }
+    qsort(nodes, n, sizeof(TLDNode *), by_name);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+    h.version   = STORE_VERSION;
+    h.byteorder = STORE_BYTEORDER;
+    h.first_day = first;
+    h.last_day  = last;
+    h.total     = tldlist_count(tld);
+    h.size      = n;
+    h.ndays     = (tldlist_count_range(tld, first, last) < 0) ? 0 : date_days(last) - date_days(first) + 1;
+    h.registers = tldlist_has_sketches(tld) ? HLL_REGISTERS : 0;
+    h.keys      = sizeof(h);
+    h.sums      = h.keys + n * sizeof(struct tldstore_key);
+    h.sketches  = h.sums + (h.ndays > 0 ? (n + 1) * (h.ndays + 1) * sizeof(int64_t) : 0);
+    h.names     = h.sketches + n * h.registers;
+    h.length    = h.names;
+    for (i = 0; i < n; i++) {
+        h.length += strlen(tldnode_tldname(nodes[i])) + 1;
+    }
+    if (h.length - h.names > UINT32_MAX) { goto done; }
+
+    sprintf(tmp, "%s.tmp", path);
+    s.fp = fopen(tmp, "wb");
+    if (s.fp == NULL) { goto done; }
+
+    // The header goes out with a zero checksum and is rewritten once the rest is summed
+    put(&s, &h, sizeof(h));
+    for (i = 0; i < n; i++) {
+        key.name  = (uint32_t) offset;
+        key.len   = (uint32_t) strlen(tldnode_tldname(nodes[i]));
+        key.count = tldnode_count(nodes[i]);
+        offset += key.len + 1;
+        put(&s, &key, sizeof(key));
+    }
+    if (h.ndays > 0) {
+        put_sums(&s, tld, NULL, first, h.ndays);
+        for (i = 0; i < n; i++) {
+            put_sums(&s, tld, nodes[i], first, h.ndays);
+        }
+    }
+    for (i = 0; i < n && h.registers > 0; i++) {
+        put(&s, tldnode_sketch(nodes[i]), h.registers);
+    }
+    for (i = 0; i < n; i++) {
+        char *name = tldnode_tldname(nodes[i]);
+        put(&s, name, strlen(name) + 1);
+    }
+    h.checksum = s.checksum;
+    if (fseek(s.fp, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, s.fp) != 1) { s.error = 1; }
+    if (fclose(s.fp) != 0) { s.error = 1; }
+    s.fp = NULL;
+    if (s.error || rename(tmp, path) != 0) {
+        unlink(tmp);
+        goto done;
+    }
+    status = 0;
+
+done:
+    if (s.fp != NULL) { fclose(s.fp); unlink(tmp); }
+    if (tmp != NULL) { mem_free(tmp); }
+    if (it != NULL) { tldlist_iter_destroy(it); }
+    if (nodes != NULL) { mem_free(nodes); }
+    return status;
+}
+
+TLDList *tldlist_load(const char *path, enum tldlist_backend backend) {
+    TLDStore *store = tldstore_open(path);
+    if (store == NULL) { return NULL; }
+    // Every byte is about to be read anyway
+    if (!tldstore_verify(store)) {
+        tldstore_close(store);
+        return NULL;
+    }
+
+    const struct tldstore_header *h = store->header;
+    TLDList *tld = NULL;
+    Date *begin = date_unpack(h->first_day);
+    Date *end = date_unpack(h->last_day);
+    if (begin != NULL && end != NULL) {
+        tld = (h->ndays > 0) ? tldlist_create_bucketed(begin, end, backend)
+                             : tldlist_create_backend(begin, end, backend);
+    }
+    if (tld != NULL && h->registers > 0 && !tldlist_set_distinct(tld)) {
+        tldlist_destroy(tld);
+        tld = NULL;
+    }
+
+    // Without buckets every count goes on the first day; with them, each
+    // day's count is the step between neighbouring prefix sums
+    for (uint64_t i = 0; tld != NULL && i < h->size; i++) {
+        const char *name = store->names + store->keys[i].name;
+        size_t len = store->keys[i].len;
+        int ok = 1;
+        if (h->ndays == 0) {
+            ok = tldlist_add_count(tld, name, len, h->first_day, store->keys[i].count);
+        } else {
+            const int64_t *row = store->sums + (i + 1) * (h->ndays + 1);
+            for (uint64_t day = 0; ok && day < h->ndays; day++) {
+                long count = row[day + 1] - row[day];
+                if (count > 0) {
+                    ok = tldlist_add_count(tld, name, len, date_from_days(store->day0 + day), count);
+                }
+            }
+        }
+        if (ok && h->registers > 0) {
+            ok = tldlist_add_sketch(tld, name, len, tldstore_key_sketch(store, i));
+        }
+        if (!ok) {
+            tldlist_destroy(tld);
+            tld = NULL;
+        }
+    }
+
+    if (begin != NULL) { date_destroy(begin); }
+    if (end != NULL) { date_destroy(end); }
+    tldstore_close(store);
+    return tld;
+}
+
+static uint64_t checksum(uint64_t hash, const void *p, size_t n) {
+    const unsigned char *s = p;
+    for (size_t i = 0; i < n; i++) {
+        hash ^= s[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static void put(struct saver *s, const void *p, size_t n) {
+    s->checksum = checksum(s->checksum, p, n);
+    if (fwrite(p, 1, n, s->fp) != n) {
+        s->error = 1;
+    }
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcasecmp(tldnode_tldname(*(TLDNode * const *)a), tldnode_tldname(*(TLDNode * const *)b));
+}
+
+// Writes the prefix sums over the window for `node', or for the whole list if NULL
+static void put_sums(struct saver *s, TLDList *tld, TLDNode *node, uint32_t first, long ndays) {
+    int64_t sum = 0;
+    long day0 = date_days(first);
+    put(s, &sum, sizeof(sum));
+    for (long day = 0; day < ndays; day++) {
+        uint32_t date = date_from_days(day0 + day);
+        sum = (node == NULL) ? tldlist_count_range(tld, first, date)
+                             : tldnode_count_range(tld, node, first, date);
+        put(s, &sum, sizeof(sum));
+    }
+}
+
+/*
+/
+/ Store Implementation
+/
+*/
+
+TLDStore *tldstore_open(const char *path) {
+    struct stat st;
+    void *base;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (size_t) st.st_size < sizeof(struct tldstore_header)) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) { return NULL; }
+
+    TLDStore *store = (TLDStore *) mem_malloc(sizeof(TLDStore));
+    if (store == NULL) {
+        munmap(base, (size_t) st.st_size);
+        return NULL;
+    }
+    store->base = base;
+    store->length = (size_t) st.st_size;
+    store->header = base;
+    if (!store_check(store)) {
+        tldstore_close(store);
+        return NULL;
+    }
+    store->keys  = (const struct tldstore_key *) (store->base + store->header->keys);
+    store->sums     = (const int64_t *) (store->base + store->header->sums);
+    store->sketches = store->base + store->header->sketches;
+    store->names    = (const char *) (store->base + store->header->names);
+    store->day0  = date_days(store->header->first_day);
+    return store;
+}
+
+int tldstore_verify(TLDStore *store) {
+    return store_checksum(store) == store->header->checksum;
+}
+
+int tldstore_has_sketches(TLDStore *store) {
+    return store->header->registers > 0;
+}
+
+void tldstore_window(TLDStore *store, uint32_t *begin, uint32_t *end) {
+    *begin = store->header->first_day;
+    *end = store->header->last_day;
+}
+
+long tldstore_count(TLDStore *store) {
+    return store->header->total;
+}
+
+long tldstore_size(TLDStore *store) {
+    return store->header->size;
+}
+
+long tldstore_find(TLDStore *store, const char *name) {
+    long lo = 0, hi = (long) store->header->size - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        int diff = strcasecmp(name, store->names + store->keys[mid].name);
+        if (diff == 0) { return mid; }
+        if (diff < 0) { hi = mid - 1; } else { lo = mid + 1; }
+    }
+    return -1;
+}
+
+const char *tldstore_name(TLDStore *store, long index) {
+    return store->names + store->keys[index].name;
+}
+
+long tldstore_key_count(TLDStore *store, long index) {
+    return store->keys[index].count;
+}
+
+const uint8_t *tldstore_key_sketch(TLDStore *store, long index) {
+    if (store->header->registers == 0) { return NULL; }
+    return store->sketches + index * store->header->registers;
+}
+
+long tldstore_key_distinct(TLDStore *store, long index) {
+    const uint8_t *sketch = tldstore_key_sketch(store, index);
+    return (sketch == NULL) ? -1 : hll_estimate(sketch);
+}
+
+long tldstore_count_range(TLDStore *store, uint32_t begin, uint32_t end) {
+    return store_range(store, 0, begin, end);
+}
+
+long tldstore_key_count_range(TLDStore *store, long index, uint32_t begin, uint32_t end) {
+    return store_range(store, index + 1, begin, end);
+}
+
+void tldstore_close(TLDStore *store) {
+    munmap((void *) store->base, store->length);
+    mem_free(store);
+}
+
+// Checks everything a query relies on, so that none of them need to
+static int store_check(TLDStore *store) {
+    struct tldstore_header h = *store->header;
+
+    if (memcmp(h.magic, STORE_MAGIC, sizeof(h.magic)) != 0 || h.version != STORE_VERSION) { return 0; }
+    if (h.byteorder != STORE_BYTEORDER || h.length != store->length) { return 0; }
+    if (h.first_day > h.last_day || h.keys != sizeof(h)) { return 0; }
+    if (h.ndays > 0 && h.ndays != (uint64_t) (date_days(h.last_day) - date_days(h.first_day) + 1)) { return 0; }
+    if (h.registers != 0 && h.registers != HLL_REGISTERS) { return 0; }
+
+    // Bound the sizes by the file length before multiplying them out
+    if (h.size > h.length / sizeof(struct tldstore_key)) { return 0; }
+    if (h.ndays > 0 && h.size + 1 > h.length / ((h.ndays + 1) * sizeof(int64_t))) { return 0; }
+    if (h.sums != h.keys + h.size * sizeof(struct tldstore_key)) { return 0; }
+    if (h.sketches != h.sums + (h.ndays > 0 ? (h.size + 1) * (h.ndays + 1) * sizeof(int64_t) : 0)) { return 0; }
+    if (h.registers > 0 && h.size > h.length / h.registers) { return 0; }
+    if (h.names != h.sketches + h.size * h.registers) { return 0; }
+    if (h.names > h.length) { return 0; }
+
+    // Every name must lie inside the names section and be terminated there
+    const struct tldstore_key *keys = (const struct tldstore_key *) (store->base + h.keys);
+    const char *names = (const char *) (store->base + h.names);
+    uint64_t nameslen = h.length - h.names;
+    for (uint64_t i = 0; i < h.size; i++) {
+        if ((uint64_t) keys[i].name + keys[i].len >= nameslen || names[keys[i].name + keys[i].len] != '\0') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// FNV-1a of the whole file, as it was summed with the checksum field zeroed
+static uint64_t store_checksum(TLDStore *store) {
+    struct tldstore_header h = *store->header;
+    h.checksum = 0;
+    return checksum(checksum(FNV_OFFSET, &h, sizeof(h)), store->base + sizeof(h), store->length - sizeof(h));
+}
+
+// Entries in `row' of the sums dated begin..end, clipped to the window
+static long store_range(TLDStore *store, long row, uint32_t begin, uint32_t end) {
+    long ndays = store->header->ndays;
+    if (ndays == 0) { return -1; }
+    long lo = date_days(begin) - store->day0, hi = date_days(end) - store->day0;
+    if (lo >= ndays || hi < 0) { return 0; }
+    if (lo < 0) { lo = 0; }
+    if (hi >= ndays) { hi = ndays - 1; }
+    if (lo > hi) { return 0; }
+    const int64_t *sums = store->sums + row * (ndays + 1);
+    return sums[hi + 1] - sums[lo];
+}
@@ -0,0 +1,129 @@
+#ifndef _TLDSTORE_H_INCLUDED_
+#define _TLDSTORE_H_INCLUDED_
+
+#include <stdint.h>
+#include "tldlist.h"
+
+/*
+ * a snapshot file holds the counts of a TLDList laid out so that it can be
+ * queried straight from an mmap(2) of the file:
+ *
+ *   header     magic, version, byte order, window, sizes, section offsets
+ *              and an FNV-1a checksum of the whole file
+ *   keys       one { name offset, name length, count } per TLD, sorted by
+ *              case-folded name
+ *   sums       if the list kept day buckets, (size + 1) rows of ndays + 1
+ *              prefix sums, the whole list's first and then each key's
+ *   sketches   if the list kept sketches, each key's HLL_REGISTERS bytes
+ *   names      the NUL-terminated TLD names
+ *
+ * numbers are written in the byte order of the host that saved the file,
+ * and a file from a host of the other byte order is refused, as is one
+ * whose sketches were built with a different HLL_PRECISION
+ */
+typedef struct tldstore TLDStore;
+
+/*
+ * tldlist_save writes the counts of `tld', its day buckets if it was
+ * created by tldlist_create_bucketed() and its sketches if it keeps them
+ * (see tldlist_set_distinct), to the snapshot file `path'; the
+ * file is written beside `path' and renamed over it, so readers never see
+ * a partial snapshot
+ * returns 0 if successful, -1 if not
+ */
+int tldlist_save(TLDList *tld, const char *path);
+
+/*
+ * tldlist_load creates a TLDList with the `backend' given, holding the
+ * counts in the snapshot file `path', whose checksum it verifies; it is
+ * bucketed if the snapshot is, and keeps sketches if the snapshot has them;
+ * to report on a snapshot, querying it in place with the functions below
+ * saves rebuilding the list
+ * returns a pointer to the list if successful, NULL if not (unreadable or
+ * corrupt file, or memory allocation failure)
+ */
+TLDList *tldlist_load(const char *path, enum tldlist_backend backend);
+
+/*
+ * tldstore_open maps the snapshot file `path' read-only and checks its
+ * layout, so that no query can reach outside the mapping; nothing is copied
+ * out of it, and the checksum, which needs every byte read, is left to
+ * tldstore_verify()
+ * returns a pointer to the store if successful, NULL if not
+ */
+TLDStore *tldstore_open(const char *path);
+
+/*
+ * tldstore_verify checks the snapshot's contents against its checksum
+ * returns 1 if they match, 0 if not
+ */
+int tldstore_verify(TLDStore *store);
+
+/*
+ * tldstore_window stores the snapshot's begin and end dates, packed, in
+ * `begin' and `end'
+ */
+void tldstore_window(TLDStore *store, uint32_t *begin, uint32_t *end);
+
+/*
+ * tldstore_count returns the number of entries counted in the snapshot
+ */
+long tldstore_count(TLDStore *store);
+
+/*
+ * tldstore_size returns the number of distinct TLDs in the snapshot
+ */
+long tldstore_size(TLDStore *store);
+
+/*
+ * tldstore_has_sketches returns 1 if the snapshot has a sketch of each TLD,
+ * 0 if not
+ */
+int tldstore_has_sketches(TLDStore *store);
+
+/*
+ * tldstore_find returns the index of the TLD `name', compared without
+ * regard to case, by binary search of the key table; -1 if it is absent
+ */
+long tldstore_find(TLDStore *store, const char *name);
+
+/*
+ * tldstore_name returns the name of the TLD at `index' (0 .. size - 1)
+ */
+const char *tldstore_name(TLDStore *store, long index);
+
+/*
+ * tldstore_key_count returns the count of the TLD at `index'
+ */
+long tldstore_key_count(TLDStore *store, long index);
+
+/*
+ * tldstore_key_sketch returns the HLL_REGISTERS bytes of the sketch of the
+ * TLD at `index', straight from the mapping; NULL if the snapshot has none
+ */
+const uint8_t *tldstore_key_sketch(TLDStore *store, long index);
+
+/*
+ * tldstore_key_distinct returns the estimated number of distinct hostnames
+ * of the TLD at `index', -1 if the snapshot has no sketches
+ */
+long tldstore_key_distinct(TLDStore *store, long index);
+
+/*
+ * tldstore_count_range returns the entries of the whole snapshot dated
+ * `begin'..`end' (packed, inclusive, clipped to the window) in O(1)
+ * returns -1 if the snapshot has no day buckets
+ */
+long tldstore_count_range(TLDStore *store, uint32_t begin, uint32_t end);
+
+/*
+ * tldstore_key_count_range is tldstore_count_range() for the TLD at `index'
+ */
+long tldstore_key_count_range(TLDStore *store, long index, uint32_t begin, uint32_t end);
+
+/*
+ * tldstore_close unmaps the snapshot and frees the store
+ */
+void tldstore_close(TLDStore *store);
+
+#endif /* _TLDSTORE_H_INCLUDED_ */
@@ -0,0 +1,32 @@
+#ifndef _TLDTABLE_H_INCLUDED_
+#define _TLDTABLE_H_INCLUDED_
+
+#include <stddef.h>
+
+/*
+ * a perfect hash table of the known TLDs in tlds.txt; tldtable.c is
+ * generated from that list by gentld when the program is built, so adding
+ * a TLD to the table is a matter of adding a line to the list
+ */
+
+/*
+ * tldtable_size is the number of known TLDs, whose indices run densely
+ * from 0 to tldtable_size - 1
+ */
+extern const long tldtable_size;
+
+/*
+ * tldtable_find returns the index of the TLD held in the `len' bytes at
+ * `name' (which need not be NUL-terminated), compared without regard to
+ * case, with one hash of the name and one comparison against the single
+ * entry it could be
+ * returns -1 if the TLD is not a known one
+ */
+long tldtable_find(const char *name, size_t len);
+
+/*
+ * tldtable_name returns the known TLD at `index', in lower case
+ */
+const char *tldtable_name(long index);
+
+#endif /* _TLDTABLE_H_INCLUDED_ */